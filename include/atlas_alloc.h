@@ -35,6 +35,23 @@
 extern "C" {
 #endif
 
+///
+/// Region open options. Any of them can be or-ed into the access
+/// flag of the interfaces below that create or find a region. They
+/// apply to the current mapping of the region only.
+///
+/// NVM_REGION_HUGEPAGE: Back the region with huge pages. The region
+/// file is mapped with MAP_HUGETLB if it lives on hugetlbfs, otherwise
+/// transparent huge pages are requested, which takes effect on tmpfs
+/// if enabled for shared memory.
+///
+/// NVM_REGION_PREFAULT: Fault in the parts of the region holding data
+/// on a background thread, so that they are not faulted in on first
+/// access. Space never handed out is left alone.
+///
+#define NVM_REGION_HUGEPAGE 0x10000000
+#define NVM_REGION_PREFAULT 0x20000000
+
 ///
 /// @brief Create a named persistent region.
 /// @param name Name of the persistent region
@@ -47,6 +64,20 @@ extern "C" {
 ///
 uint32_t NVM_CreateRegion(const char *name, int flags);
 
+///
+/// @brief Create a named persistent region of a given size.
+/// @param name Name of the persistent region
+/// @param flags access flag (one of O_RDONLY, O_WRONLY, O_RDWR)
+/// @param size Size of the region in bytes
+/// @return Id of the region created
+///
+/// Same as NVM_CreateRegion except for the size, which is rounded up
+/// to a multiple of 4MB and is at least 16MB. The default size used
+/// by NVM_CreateRegion is 4GB. Half of a region is available for
+/// objects of 256KB or more, the other half for smaller objects.
+///
+uint32_t NVM_CreateRegionWithSize(const char *name, int flags, uint64_t size);
+
 ///
 /// @brief Create a persistent region with the provided name.
 /// @param name Name of the persistent region
@@ -60,6 +91,20 @@ uint32_t NVM_CreateRegion(const char *name, int flags);
 ///
 uint32_t NVM_FindOrCreateRegion(const char *name, int flags, int *is_created);
 
+///
+/// @brief Find or create a persistent region of a given size.
+/// @param name Name of the persistent region
+/// @param flags access flag (one of O_RDONLY, O_WRONLY, O_RDWR)
+/// @param size Size of the region in bytes if it gets created
+/// @param is_created Indicator whether the region got created as a
+/// result of the call
+/// @return Id of the region found or created
+///
+/// An existing region keeps the size it was created with.
+///
+uint32_t NVM_FindOrCreateRegionWithSize(
+    const char *name, int flags, uint64_t size, int *is_created);
+
 ///
 /// @brief Find the id of a region when it is known to exist already
 /// @param name Name of the persistent region
@@ -93,6 +138,52 @@ void NVM_DeleteRegion(const char *name);
 ///
 void NVM_CloseRegion(uint32_t rid);
 
+#ifdef _REGION_SNAPSHOT
+///
+/// @brief Write a snapshot of an open persistent region to a file
+/// @param rid Region id
+/// @param path Name of the file to be written
+/// @return 0 on success, otherwise -1 with errno set
+///
+/// The snapshot reflects all failure-atomic sections completed when it
+/// is taken and none in progress. New failure-atomic sections are
+/// held back until those in progress end, then the region file is
+/// cloned, which is bounded to milliseconds on file systems that can
+/// share blocks between files (e.g. XFS, btrfs). Elsewhere the parts
+/// of the region holding data are copied by several threads while the
+/// sections are held back, which is only done for up to 16MB of data.
+/// EOPNOTSUPP is returned for a larger region. If the sections in
+/// progress do not end within 10ms, e.g. because one waits for a lock
+/// held by a thread held back, the sections are let go and the
+/// snapshot is retried. EBUSY is returned if that keeps failing.
+/// EINVAL is returned if the region is not open or is the log region.
+/// Persistent stores outside failure-atomic sections are not ordered
+/// with the snapshot.
+///
+/// The file holds the region contents followed by its descriptor in
+/// the region table, see NVM_RestoreRegion. Must not be called within
+/// a failure-atomic section.
+///
+int NVM_SnapshotRegion(uint32_t rid, const char *path);
+
+///
+/// @brief Bring a persistent region back to a snapshot of it
+/// @param path Name of a file written by NVM_SnapshotRegion
+/// @return 0 on success, otherwise -1 with errno set
+///
+/// The region gets the contents and allocator state of the snapshot,
+/// keeping the name, id and addresses it had, so that the pointers
+/// within it stay valid. Its entry in the region table must still be
+/// there, possibly deleted but not recreated with a larger size.
+/// EINVAL is returned otherwise, or if the file is not a snapshot.
+/// The region must not be open in any process, EBUSY is returned if
+/// it is open in this one. Afterwards, the region is found as usual.
+/// A restore that fails midway leaves the region deleted and can be
+/// run again.
+///
+int NVM_RestoreRegion(const char *path);
+#endif
+
 ///
 /// @brief Get the root pointer of the persistent region
 /// @param rid Region id
@@ -189,6 +280,64 @@ void *nvm_realloc(void *ptr, size_t sz, uint32_t rid);
 ///
 void nvm_free(void *ptr);
 
+///
+/// @brief Batch allocation interface for persistent data
+///
+/// @param sizes Sizes of the n locations to be allocated
+/// @param n Number of locations
+/// @param rid Id of persistent region for allocation
+/// @param out Array receiving the n addresses allocated
+///
+/// Equivalent to n calls to nvm_alloc, but contiguous runs are
+/// carved under a single arena lock acquisition, logged with a single
+/// record and flushed once.
+///
+void nvm_alloc_batch(const size_t *sizes, size_t n, uint32_t rid,
+                     void **out);
+
+///
+/// @brief Batch deallocation interface for persistent data
+///
+/// @param ptrs Addresses of the n locations to be freed
+/// @param n Number of locations
+///
+/// Equivalent to n calls to nvm_free, but the persistent locations
+/// are logged with a single record and every arena involved is locked
+/// once.
+///
+void nvm_free_batch(void **ptrs, size_t n);
+
+///
+/// @brief Create a pool of fixed-size persistent objects
+///
+/// @param rid Id of persistent region for the pool
+/// @param obj_size Size of every object of the pool
+/// @param align Alignment of the objects, a power of 2 up to a page,
+/// or 0 for pointer alignment
+/// @return Handle to the pool, itself in persistent memory
+///
+/// Objects of a pool carry no per-object header and are handed out
+/// from per-thread caches without taking a lock. The handle may be
+/// stored in persistent memory and used by later processes.
+///
+void *nvm_pool_create(uint32_t rid, size_t obj_size, size_t align);
+
+///
+/// @brief Allocate an object from a pool
+///
+/// @param pool Handle returned by nvm_pool_create
+/// @return Address of the object
+///
+void *nvm_pool_alloc(void *pool);
+
+///
+/// @brief Return an object to the pool it was allocated from
+///
+/// @param pool Handle returned by nvm_pool_create
+/// @param ptr Address of the object
+///
+void nvm_pool_free(void *pool, void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,7 +32,9 @@ extern "C" {
 
 ///
 /// Initialize Atlas internal data structures. This should be
-/// called before persistent memory access.
+/// called before persistent memory access. If the program crashed
+/// earlier, it exits asking for recovery, unless built with
+/// _IN_PROCESS_RECOVERY in which case the log is undone first.
 ///
 void NVM_Initialize();
 
@@ -83,20 +85,81 @@ void nvm_psync(void *addr, size_t sz /* in bytes */);
 ///
 void nvm_psync_acq(void *addr, size_t sz /* in bytes */);
 
+#ifdef _MSYNC_DURABILITY
+///
+/// Record the page holding an address as written. With file-backed
+/// regions, this replaces a cache line flush and the page is made
+/// durable with msync at the next sync point of the calling thread,
+/// e.g. the end of a failure-atomic section or a persistent sync.
+///
+void nvm_note_dirty(const void *addr);
+#endif
+
 // This may be invoked by a user program to print out Atlas statistics
 #ifdef NVM_STATS
     void NVM_PrintStats();
 #endif
 
+///
+/// Percentiles of a histogram of the Atlas runtime, each the upper
+/// bound of its bucket, within about 6% of the exact value
+///
+struct atlas_histogram_summary {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+///
+/// Counters of the Atlas runtime, summed over all threads including
+/// those that exited. The flushes of a thread are counted at the end
+/// of a failure-atomic section or a persistent sync.
+///
+struct atlas_stats {
+    uint64_t logged_stores;
+    uint64_t unlogged_stores;
+    uint64_t flushes;
+    uint64_t fases; /* outermost failure-atomic sections */
+    uint64_t log_bytes; /* log entries created */
+    uint64_t log_mem_bytes; /* memory taken by the log buffers */
+    uint64_t log_reclaimed_bytes; /* returned to the OS, see
+                                     _RECLAIM_MEMORY */
+    uint64_t helper_rounds;
+    uint64_t pruned_log_bytes;
+    uint64_t allocs;
+    uint64_t alloc_bytes; /* requested */
+    uint64_t frees;
+    uint64_t pruned_fases; /* the consistent state moved past */
+    uint64_t arena_lock_waits; /* allocator arena found locked */
+    /* Durations are in time stamp counter cycles */
+    struct atlas_histogram_summary fase_cycles; /* first acquire to the
+                                                   end of the FASE */
+    struct atlas_histogram_summary fase_flushes; /* per FASE */
+    struct atlas_histogram_summary end_fase_flush_cycles;
+};
+
+///
+/// Take a snapshot of the counters of the Atlas runtime. Cheap enough
+/// to be called periodically while the program runs.
+///
+void NVM_GetStats(struct atlas_stats *stats);
+
+///
+/// Print the non-empty buckets of the histograms of the Atlas runtime.
+/// Invoked at NVM_Finalize under NVM_STATS.
+///
+void NVM_PrintHistograms();
+
 #ifdef __cplusplus
 }
 #endif
 
 // End of Atlas APIs
 
-#ifdef NVM_STATS
 extern __thread uint64_t num_flushes;
-#endif
 
 // Useful macros
 #define NVM_BEGIN_DURABLE() nvm_begin_durable()
@@ -160,13 +223,15 @@ extern __thread uint64_t num_flushes;
 static __inline void nvm_clflush(const void *p)
 {
 #ifndef DISABLE_FLUSHES
-#ifdef NVM_STATS
     ++num_flushes;
-#endif
+#ifdef _MSYNC_DURABILITY
+    nvm_note_dirty(p);
+#else
     __asm__ __volatile__ (
         "clflush %0 \n" : "+m" (*(char*)(p))
         );
 #endif
+#endif
 }
 
 // Used in conjunction with clflush.
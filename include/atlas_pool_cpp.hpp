@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+
+#ifndef ATLAS_POOL_CPP_H
+#define ATLAS_POOL_CPP_H
+
+#include <new>
+#include <utility>
+
+#include "atlas_alloc.h"
+
+///
+/// @brief Typed view of a persistent object pool
+///
+/// The pool holds objects of type T only. The view itself is
+/// transient and merely wraps the handle returned by nvm_pool_create,
+/// so it can be rebuilt from a handle found in persistent memory.
+///
+template <class T> class NVM_Pool {
+public:
+    explicit NVM_Pool(void *pool) : Pool_{pool} {}
+
+    ///
+    /// @brief Create a pool for objects of type T
+    /// @param rid Id of persistent region for the pool
+    /// @return View of the new pool
+    ///
+    static NVM_Pool create(uint32_t rid)
+        { return NVM_Pool(nvm_pool_create(rid, sizeof(T), alignof(T))); }
+
+    ///
+    /// @brief Allocate an object from the pool and construct it
+    /// @param args Arguments forwarded to the constructor of T
+    /// @return Pointer to the new object
+    ///
+    template <class... Args> T *construct(Args&&... args)
+        { return new (nvm_pool_alloc(Pool_)) T(std::forward<Args>(args)...); }
+
+    ///
+    /// @brief Destroy an object and return it to the pool
+    /// @param ptr Pointer to an object constructed from this pool
+    ///
+    void destroy(T *ptr)
+        { if (!ptr) return; ptr->~T(); nvm_pool_free(Pool_, ptr); }
+
+    void *get_handle() const { return Pool_; }
+
+private:
+    void *Pool_;
+};
+
+#endif
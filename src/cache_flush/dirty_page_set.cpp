@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+
+#include <sys/mman.h>
+
+#include "dirty_page_set.hpp"
+#include "atlas_api.h"
+#include "internal_api.h"
+
+namespace Atlas {
+
+///
+/// Write back the recorded pages and wait for them, coalescing
+/// adjacent pages into a single msync
+///
+void DirtyPageSet::sync()
+{
+    if (Pages_.empty()) return;
+    std::sort(Pages_.begin(), Pages_.end());
+    uintptr_t start = Pages_[0];
+    uintptr_t end = start + kPageSize_;
+    for (uintptr_t page : Pages_) {
+        if (page < end) continue; // duplicate
+        if (page != end) {
+            syncRange(start, end);
+            start = page;
+        }
+        end = page + kPageSize_;
+    }
+    syncRange(start, end);
+    Pages_.clear();
+    LastPage_ = 0;
+}
+
+void DirtyPageSet::syncRange(uintptr_t start, uintptr_t end)
+{
+    // A region closed in the meantime was synced as a whole
+    if (msync(reinterpret_cast<void*>(start), end - start, MS_SYNC) &&
+        errno != ENOMEM)
+        perror("msync");
+}
+
+} // namespace Atlas
+
+#if defined(_MSYNC_DURABILITY)
+
+// Log pages are kept apart since they are synced much more often
+static thread_local Atlas::DirtyPageSet TL_DirtyPages;
+static thread_local Atlas::DirtyPageSet TL_DirtyLogPages;
+
+void nvm_note_dirty(const void *addr)
+{
+    TL_DirtyPages.insert(addr);
+}
+
+void nvm_note_dirty_log(const void *addr)
+{
+    TL_DirtyLogPages.insert(addr);
+}
+
+void nvm_sync_dirty_log_pages()
+{
+    TL_DirtyLogPages.sync();
+}
+
+void nvm_sync_dirty_pages()
+{
+    // Log pages go first so that undo information is never behind
+    TL_DirtyLogPages.sync();
+    TL_DirtyPages.sync();
+}
+
+#endif
@@ -45,6 +45,9 @@ void LogMgr::psync(void *start_addr, size_t sz)
 {
     psyncWithAcquireBarrier(start_addr, sz);
     full_fence();
+#if defined(_MSYNC_DURABILITY)
+    nvm_sync_dirty_pages();
+#endif
 }
 
 void LogMgr::flushAtEndOfFase()
@@ -58,6 +61,10 @@ void LogMgr::flushAtEndOfFase()
 #elif defined(_USE_TABLE_FLUSH) && !defined(DISABLE_FLUSHES)
     syncDataFlush();
 #endif
+#if defined(_MSYNC_DURABILITY) && !defined(DISABLE_FLUSHES)
+    // The end of a FASE is the commit point of its data
+    nvm_sync_dirty_pages();
+#endif
 }
         
 } // namespace Atlas
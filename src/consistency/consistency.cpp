@@ -106,7 +106,8 @@ void CSMgr::resolvePendingList()
         LogEntry *le = ci->first;
         
         assert(le);
-        assert(le->isAcquire());
+        assert(le->isAcquire() || le->isAllocation() ||
+               le->isDeallocation());
         assert(le->ValueOrPtr);
 
         const DGraph::NodeInfo& node_info = 
@@ -285,6 +286,8 @@ void CSMgr::createVersions(Helper::LogVersions *log_v)
             }
             else {
                 collectLogs(&deletable_logs, fase);
+                if (!IsInRecovery_)
+                    StatsRegistry::increment(kPrunedFaseCount);
                 last_fase = fase;
                 fase = fase->Next;
             }
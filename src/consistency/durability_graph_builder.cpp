@@ -30,6 +30,15 @@ static inline void addThreadNode(
     thread_nodes->insert(std::make_pair(nid, true));
 }
 
+// A free may be found by any number of later log entries, so it is
+// not tracked in the map of deleted releases. Its address is cleared
+// when it is deleted instead, see destroyLogEntries. Its slot may
+// hold a newer free by now, which only delays the dependent FASE.
+static inline bool isLiveDeallocation(LogEntry *le, uint64_t gen_num)
+{
+    return le->isDeallocation() && le->Addr && le->Size == gen_num;
+}
+
 static inline bool hasThreadNode(
     const CSMgr::MapNodes& thread_nodes, DGraph::VDesc nid) 
 {
@@ -45,6 +54,13 @@ void CSMgr::buildInitialGraph(LogStructure *lsp)
     uint64_t start_graph_build = atlas_rdtsc();
 #endif
     
+    uint32_t fase_limit = kFaseAnalysisLimit;
+#if defined(_BOUNDED_RECOVERY)
+    // Catch up faster while user threads are waiting on the log budget
+    if (!IsInRecovery_ && LogMgr::getInstance().isLogOverBudget())
+        fase_limit = kFaseAnalysisLimitOverBudget;
+#endif
+
     // This loop goes through the log entries of one thread at a time
     while (lsp) {
         LogEntry *current_le = lsp->Le;
@@ -64,7 +80,7 @@ void CSMgr::buildInitialGraph(LogStructure *lsp)
 
             // There is a configurable maximum number of FASEs chosen
             // from a given thread in a given analysis step
-            if (fase_count > kFaseAnalysisLimit) break;
+            if (fase_count > fase_limit) break;
                 
             if (areUserThreadsDone()) {
                 IsParentDone_ = true;
@@ -158,29 +174,35 @@ void CSMgr::buildInitialGraph(LogStructure *lsp)
 /// creation.
 /// If "le" is of release type, track it for future synchronizes-with
 /// relationship creation.
+/// An allocation or a free is handled like an acquire of the free
+/// logged before it, and a free like a release. The memory it hands
+/// out may otherwise still be in use by the FASE of that free.
 ///    
-// TODO: do other log types need handling? free and rw-type    
+// TODO: do other log types need handling? rw-type    
 void CSMgr::addSyncEdges(
     const MapNodes& thread_nodes, LogEntry *le, DGraph::VDesc nid)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
+    bool is_alloc_free = le->isAllocation() || le->isDeallocation();
+    
     // First filter out the scenario where the target is already deleted
-    if (le->isAcquire() && le->ValueOrPtr) {
+    if ((le->isAcquire() || is_alloc_free) && le->ValueOrPtr) {
         LogEntry *rel_le = (LogEntry*)(le->ValueOrPtr);
 
-        // Note: the following call deletes the found entry.
-        // ValueOrPtr is currently not of atomic type. This
+        // Note: the following call deletes the found entry of a
+        // release. ValueOrPtr is currently not of atomic type. This
         // is still ok as long as there is a single helper
         // thread. 
-        if (Helper::getInstance().isDeletedByHelperThread(rel_le, le->Size))
+        if (is_alloc_free ? !isLiveDeallocation(rel_le, le->Size) :
+            Helper::getInstance().isDeletedByHelperThread(rel_le, le->Size))
             le->ValueOrPtr = 0;
         else if (IsInRecovery_ && !isFoundInExistingLog(rel_le, le->Size))
             le->ValueOrPtr = 0;
     }
                         
-    if (le->isAcquire() && le->ValueOrPtr) {
+    if ((le->isAcquire() || is_alloc_free) && le->ValueOrPtr) {
         const DGraph::NodeInfo& node_info = 
             Graph_.getTargetNodeInfo((LogEntry *)le->ValueOrPtr);
         if (node_info.NodeType_ == DGraph::kAvail) {
@@ -190,7 +212,8 @@ void CSMgr::addSyncEdges(
         else if (node_info.NodeType_ == DGraph::kAbsent)
             addToPendingList(le, nid);
     }
-    else if (le->isRelease())
+    
+    if (le->isRelease() || le->isDeallocation())
         Graph_.addToNodeInfoMap(le, nid, DGraph::kAvail);
 }
     
@@ -311,6 +334,18 @@ void DGraph::PrintLogs(FASection *fase)
             case LE_free:
                 PrintFreeLog(current_le);
                 break;
+            case LE_alloc_batch:
+                PrintAllocBatchLog(current_le);
+                break;
+            case LE_free_batch:
+                PrintFreeBatchLog(current_le);
+                break;
+            case LE_pool_alloc:
+                PrintPoolAllocLog(current_le);
+                break;
+            case LE_pool_free:
+                PrintPoolFreeLog(current_le);
+                break;
             default:
                 assert(0);
         }
@@ -472,5 +507,61 @@ void DGraph::PrintFreeLog(LogEntry *le)
     traceHelper(" type = free next = ");
     traceHelper(le->Next.load(std::memory_order_relaxed));
 }
+
+void DGraph::PrintAllocBatchLog(LogEntry *le)
+{
+    traceHelper("\t\tle = ");
+    traceHelper(le);
+    traceHelper(" addr = ");
+    traceHelper(le->Addr);
+    traceHelper(" size = ");
+    traceHelper(le->Size);
+    traceHelper(" type = alloc_batch next = ");
+    traceHelper(le->Next.load(std::memory_order_relaxed));
+}
+
+void DGraph::PrintFreeBatchLog(LogEntry *le)
+{
+    traceHelper("\t\tle = ");
+    traceHelper(le);
+    traceHelper(" addr = ");
+    traceHelper(le->Addr);
+    traceHelper(" count = ");
+    traceHelper(*static_cast<size_t*>(le->Addr));
+    traceHelper(" val = ");
+    traceHelper((void*)le->ValueOrPtr);
+    traceHelper(" size = ");
+    traceHelper(le->Size);
+    traceHelper(" type = free_batch next = ");
+    traceHelper(le->Next.load(std::memory_order_relaxed));
+}
+
+void DGraph::PrintPoolAllocLog(LogEntry *le)
+{
+    traceHelper("\t\tle = ");
+    traceHelper(le);
+    traceHelper(" addr = ");
+    traceHelper(le->Addr);
+    traceHelper(" val = ");
+    traceHelper((void*)le->ValueOrPtr);
+    traceHelper(" size = ");
+    traceHelper(le->Size);
+    traceHelper(" type = pool_alloc next = ");
+    traceHelper(le->Next.load(std::memory_order_relaxed));
+}
+
+void DGraph::PrintPoolFreeLog(LogEntry *le)
+{
+    traceHelper("\t\tle = ");
+    traceHelper(le);
+    traceHelper(" addr = ");
+    traceHelper(le->Addr);
+    traceHelper(" val = ");
+    traceHelper((void*)le->ValueOrPtr);
+    traceHelper(" size = ");
+    traceHelper(le->Size);
+    traceHelper(" type = pool_free next = ");
+    traceHelper(le->Next.load(std::memory_order_relaxed));
+}
         
 } // namespace Atlas
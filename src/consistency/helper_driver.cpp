@@ -67,7 +67,8 @@ void Helper::collectRelLogEntries(LogStructure *lsp)
     while (lsp) {
         LogEntry *le = lsp->Le;
         while (le) {
-            if (le->isRelease()) // TODO: how about free and other rel types?
+            // TODO: how about other rel types?
+            if (le->isRelease() || le->isDeallocation())
                 ExistingRelMap_.insert(std::make_pair(le, (uint64_t)le->Size));
             le = le->Next;
         }
@@ -131,7 +132,17 @@ void Helper::doConsistentUpdate(void *arg_lsp)
         CSMgr& cs_mgr = CSMgr::createInstance();
         if (IsInRecovery_)
             cs_mgr.set_existing_rel_map(&ExistingRelMap_);
+        uint64_t prev_removed_log_count = removed_log_count;
         cs_mgr.doConsistentUpdate(lsp, &LogVersions_, IsInRecovery_);
+        if (!IsInRecovery_) {
+            LogMgr::getInstance().notePrunedLogEntries(
+                removed_log_count - prev_removed_log_count);
+            StatsRegistry::increment(kHelperRoundCount);
+            StatsRegistry::increment(
+                kPrunedLogEntryCount,
+                removed_log_count - prev_removed_log_count);
+            StatsRegistry::publishFlushes();
+        }
         
         if (IsInRecovery_ && !cs_mgr.get_num_graph_vertices()) {
             CSMgr::deleteInstance();
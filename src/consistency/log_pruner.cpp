@@ -209,6 +209,11 @@ void CSMgr::destroyLogs(Helper::LogVersions *log_v)
             if (!CSMgr::getInstance().isInRecovery())
                 LogMgr::getInstance().flushLogPointer();
             else LogMgr::getInstance().flushRecoveryLogPointer();
+#if defined(_MSYNC_DURABILITY)
+            // Commit point of the helper: the log entries now
+            // unreachable are destroyed below
+            nvm_sync_dirty_pages();
+#endif
 #endif
             
 #if defined(_FLUSH_GLOBAL_COMMIT) && !defined(DISABLE_FLUSHES) && \
@@ -310,7 +315,8 @@ void CSMgr::destroyLogEntries(const LogEntryVec& le_vec)
     {
         traceHelper(*ci);
         
-        if ((*ci)->isRelease() || (*ci)->isRWLockUnlock() || (*ci)->isFree())
+        if ((*ci)->isRelease() || (*ci)->isRWLockUnlock() ||
+            (*ci)->isDeallocation())
         {
             // Add it to a helper map so that the helper elides any
             // happens-after relation from a later-examined log entry
@@ -322,19 +328,41 @@ void CSMgr::destroyLogEntries(const LogEntryVec& le_vec)
             if (!CSMgr::getInstance().isInRecovery()) LogMgr::getInstance().deleteOwnerInfo(*ci);
         }
 
+        // Later allocations and frees may still point to a deleted
+        // free. Clearing its address tells them so, see addSyncEdges.
+        void *addr = (*ci)->Addr;
+        if ((*ci)->isDeallocation()) (*ci)->Addr = nullptr;
+        
         if (!CSMgr::getInstance().isInRecovery())
         {
+            // Let the allocator know the free can no longer be undone
+            if ((*ci)->isFree())
+                PRegionMgr::getInstance().completeFree(addr);
+#if defined(_RECLAIM_MEMORY)
+            else if ((*ci)->isFreeBatch()) {
+                size_t *buf = static_cast<size_t*>(addr);
+                for (size_t i = 1; i <= buf[0]; ++i)
+                    PRegionMgr::getInstance().completeFree(
+                        reinterpret_cast<void*>(buf[i]));
+            }
+#endif
+            
 #if defined(_LOG_WITH_MALLOC)
             if ((*ci)->isMemop() || (*ci)->isStrop())
                 free((void*)(*ci)->ValueOrPtr);
+            else if ((*ci)->isFreeBatch()) free(addr);
             free(*ci);
 #elif defined(_LOG_WITH_NVM_ALLOC)
             if ((*ci)->isMemop() || (*ci)->isStrop())
                 PRegionMgr::getInstance().freeMem((void*)(*ci)->ValueOrPtr, true);
+            else if ((*ci)->isFreeBatch())
+                PRegionMgr::getInstance().freeMem(addr, true);
             PRegionMgr::getInstance().freeMem(*ci, true /* do not log */);
 #else        
             if ((*ci)->isMemop() || (*ci)->isStrop())
                 PRegionMgr::getInstance().freeMem((void*)(*ci)->ValueOrPtr, true);
+            else if ((*ci)->isFreeBatch())
+                PRegionMgr::getInstance().freeMem(addr, true);
             // TODO cache LogMgr instance
             LogMgr::getInstance().deleteEntry(*ci);
 #endif
@@ -428,6 +456,10 @@ void CSMgr::flushGlobalCommit(const LogEntryVec& logs)
                 GlobalFlush_, (*ci)->Addr, (*ci)->Size);
     LogMgr::getInstance().flushCacheLines(*GlobalFlush_);
     GlobalFlush_->clear();
+#if defined(_MSYNC_DURABILITY)
+    // Before the log entries covering the data go away
+    nvm_sync_dirty_pages();
+#endif
 }
 
 #endif
@@ -459,7 +491,8 @@ void LogMgr::deleteEntry(const std::atomic<CbListNode<T>*> & cb_list, T *addr)
         deleteSlot<T>(last_cb_used->Cb, addr);
         if (last_cb_used->Cb->isEmpty() &&
             last_cb_used->Cb->isFilled.load(std::memory_order_acquire))
-            last_cb_used->isAvailable.store(true, std::memory_order_release);
+            last_cb_used->isAvailable.store(
+                kCbAvailable, std::memory_order_release);
         return;
     }
     CbListNode<T> *curr = cb_list.load(std::memory_order_acquire);
@@ -474,7 +507,8 @@ void LogMgr::deleteEntry(const std::atomic<CbListNode<T>*> & cb_list, T *addr)
             // available so that it can be reused.
             if (curr->Cb->isEmpty() &&
                 curr->Cb->isFilled.load(std::memory_order_acquire))
-                curr->isAvailable.store(true, std::memory_order_release);
+                curr->isAvailable.store(
+                    kCbAvailable, std::memory_order_release);
             break;
         }
         curr = curr->Next;
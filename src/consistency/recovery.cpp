@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "atlas_alloc.h"
+#include "pregion_mgr.hpp"
+#include "pmalloc_util.hpp"
+#include "log_mgr.hpp"
+#include "internal_api.h"
+#include "recovery.hpp"
+
+namespace Atlas {
+
+Recovery *Recovery::Instance_{nullptr};
+
+Recovery::Recovery(region_id_t log_rid, bool does_report)
+    : NumDoneNodes_{0}, NumBusyWorkers_{0}, ReplayedCount_{0},
+      DoesReport_{does_report}
+{
+    pthread_mutex_init(&ReadyLock_, NULL);
+    pthread_cond_init(&ReadyCondition_, NULL);
+
+    PRegion *log_rgn = PRegionMgr::getInstance().getPRegion(log_rid);
+    void *log_base_addr = log_rgn->get_base_addr();
+    InsertToMapInterval(&MappedPRs_,
+                        (uint64_t)log_base_addr,
+                        (uint64_t)((char*)log_base_addr+log_rgn->get_size()),
+                        log_rid);
+}
+
+Recovery::~Recovery()
+{
+    pthread_cond_destroy(&ReadyCondition_);
+    pthread_mutex_destroy(&ReadyLock_);
+}
+
+uint64_t Recovery::getTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void Recovery::reportPhase(const char *phase, uint64_t *start_ns)
+{
+    uint64_t now = getTimeNs();
+    fprintf(stderr, "[Atlas] Recovery phase %s: %.3f ms\n",
+            phase, (now - *start_ns) / 1e6);
+    *start_ns = now;
+}
+
+///
+/// Advance the consistent state as far as the log allows and undo
+/// the rest of the log
+///
+bool Recovery::run()
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    uint64_t start_ns = getTimeNs();
+
+    LogStructure *lsp = getLogStructureHeader();
+
+    // This can happen if logs were never created by the user threads
+    // or if the log entry was deleted by the region manager but there
+    // was a failure before the log file was removed.
+    
+    // Note that if logs are ever created, there should be some remnants
+    // after a crash since the helper thread never removes everything.
+    if (!lsp) return false;
+
+#if !defined(_FLUSH_GLOBAL_COMMIT)
+    helper(lsp);
+    if (DoesReport_) reportPhase("consistent state", &start_ns);
+#endif
+    
+    LogStructure *recovery_lsp =
+        LogMgr::getInstance().getRecoveryLogPointer(std::memory_order_acquire);
+    if (recovery_lsp) lsp = recovery_lsp;
+    
+    scanLogs(lsp);
+    if (DoesReport_) reportPhase("log scan", &start_ns);
+
+    buildGraph();
+    if (DoesReport_) reportPhase("dependency graph", &start_ns);
+
+    mapRegions();
+    if (DoesReport_) reportPhase("region mapping", &start_ns);
+
+    undo();
+    if (DoesReport_) reportPhase("undo", &start_ns);
+    return true;
+}
+
+LogStructure *Recovery::getLogStructureHeader() const
+{
+    // TODO use atomics
+    LogStructure **lsh_p =
+        (LogStructure**)NVM_GetRegionRoot(
+            LogMgr::getInstance().getRegionId());
+    if (!lsh_p) {
+        std::cout <<
+            "[Atlas] Region root is null: did you forget to set it?"
+                  << std::endl;
+        return nullptr;
+    }
+    return (LogStructure*)*lsh_p;
+}
+
+void LogEntryIndex::init(size_t num_entries)
+{
+    // Keep the table at most half full
+    uint32_t bits = 1;
+    while ((1ULL << bits) < 2 * num_entries) ++ bits;
+    Shift_ = 64 - bits;
+    Keys_.assign(1ULL << bits, nullptr);
+    Positions_.resize(1ULL << bits);
+}
+
+void LogEntryIndex::insert(LogEntry *le, uint32_t pos)
+{
+    uint64_t mask = Keys_.size() - 1;
+    uint64_t slot = getSlot(le);
+    while (Keys_[slot] && Keys_[slot] != le) slot = (slot + 1) & mask;
+    Keys_[slot] = le;
+    Positions_[slot] = pos;
+}
+
+bool LogEntryIndex::find(LogEntry *le, uint32_t *pos) const
+{
+    uint64_t mask = Keys_.size() - 1;
+    for (uint64_t slot = getSlot(le); Keys_[slot];
+         slot = (slot + 1) & mask)
+        if (Keys_[slot] == le) {
+            *pos = Positions_[slot];
+            return true;
+        }
+    return false;
+}
+
+void Recovery::scanLogs(LogStructure *lsp)
+{
+    // The log of a thread starts at the oldest entry not pruned
+    // yet. Most of the time this is a dummy entry but that cannot be
+    // guaranteed. The helper thread commits changes atomically by
+    // switching the log structure header pointer. The logs are
+    // destroyed after this atomic switch.
+    while (lsp)
+    {
+        ThreadOffsets_.push_back(LogEntries_.size());
+        for (LogEntry *le = lsp->Le; le; le = le->Next)
+        {
+            if ((le->isStartSection() || le->isAllocation() ||
+                 le->isDeallocation()) && le->ValueOrPtr)
+                AcquirePositions_.push_back(LogEntries_.size());
+            LogEntries_.push_back(le);
+        }
+        lsp = lsp->Next;
+    }
+    ThreadOffsets_.push_back(LogEntries_.size());
+    assert(LogEntries_.size() < UINT32_MAX);
+
+    LogIndex_.init(LogEntries_.size());
+    for (uint32_t i = 0; i < LogEntries_.size(); ++ i)
+        LogIndex_.insert(LogEntries_[i], i);
+}
+
+int Recovery::getThreadOfPosition(uint32_t pos) const
+{
+    return std::upper_bound(ThreadOffsets_.begin(), ThreadOffsets_.end(),
+                            pos) - ThreadOffsets_.begin() - 1;
+}
+
+// Run holding the log entry at a given position, runs start at cuts
+static uint32_t findNode(const std::vector<uint32_t> & cuts, uint32_t pos)
+{
+    return std::upper_bound(cuts.begin(), cuts.end(), pos) - cuts.begin() - 1;
+}
+
+///
+/// Cut the log of every thread into runs and link the runs so that a
+/// run is undone only after the runs that happened after it
+///
+void Recovery::buildGraph()
+{
+    // Thread boundaries are cuts as well
+    std::vector<uint32_t> cuts(ThreadOffsets_);
+    std::vector<std::pair<uint32_t /* acquire */, uint32_t /* release */> >
+        relations;
+    for (size_t i = 0; i < AcquirePositions_.size(); ++ i) {
+        uint32_t acq_pos = AcquirePositions_[i];
+        LogEntry *acq_le = LogEntries_[acq_pos];
+        LogEntry *rel_le = (LogEntry *)(acq_le->ValueOrPtr);
+        // The release may have been pruned and its log entry reused,
+        // in which case the generation numbers differ
+        uint32_t rel_pos;
+        if (!LogIndex_.find(rel_le, &rel_pos)) continue;
+        if (!(rel_le->isEndSection() || rel_le->isDeallocation()) ||
+            rel_le->Size != acq_le->Size) continue;
+        // Program order takes care of it
+        if (getThreadOfPosition(rel_pos) == getThreadOfPosition(acq_pos))
+            continue;
+        // The release is undone after the acquire, think of a free
+        // followed by an allocation of the same memory
+        cuts.push_back(rel_pos + 1);
+        cuts.push_back(acq_pos);
+        relations.push_back(std::make_pair(acq_pos, rel_pos));
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+    // The last cut is past all log entries
+    int tid = 0;
+    std::vector<std::pair<uint32_t /* from */, uint32_t /* to */> > edges;
+    for (size_t i = 0; i + 1 < cuts.size(); ++ i) {
+        while (ThreadOffsets_[tid + 1] <= cuts[i]) ++ tid;
+        RecoveryNode node;
+        node.Tid = tid;
+        node.Lo = cuts[i];
+        node.Hi = cuts[i + 1];
+        node.NumPreds = 0;
+        // The later runs of a thread are undone first
+        if (i && Nodes_.back().Tid == tid)
+            edges.push_back(std::make_pair(i, i - 1));
+        Nodes_.push_back(node);
+    }
+    for (size_t i = 0; i < relations.size(); ++ i)
+        edges.push_back(std::make_pair(findNode(cuts, relations[i].first),
+                                       findNode(cuts, relations[i].second)));
+
+    SuccOffsets_.assign(Nodes_.size() + 1, 0);
+    for (size_t i = 0; i < edges.size(); ++ i) {
+        ++ SuccOffsets_[edges[i].first + 1];
+        ++ Nodes_[edges[i].second].NumPreds;
+    }
+    for (size_t n = 0; n < Nodes_.size(); ++ n)
+        SuccOffsets_[n + 1] += SuccOffsets_[n];
+    Succs_.resize(edges.size());
+    std::vector<uint32_t> fill(SuccOffsets_.begin(), SuccOffsets_.end() - 1);
+    for (size_t i = 0; i < edges.size(); ++ i)
+        Succs_[fill[edges[i].first] ++] = edges[i].second;
+}
+
+// Map the persistent region (PR) holding an address unless already
+// done, and return the address range of the PR. All open PRs have an
+// entry in MappedPRs_. We assume that no transient location is logged
+// since it must have been filtered out during logging.
+std::pair<uint64_t, uint64_t> Recovery::ensureMapped(void *addr)
+{
+    std::pair<void*,uint32_t> mapper_result =
+        PRegionMgr::getInstance().ensurePRegionMapped(addr);
+    uint64_t start = (uint64_t)(char*)mapper_result.first;
+    uint64_t end = start + PRegionMgr::getInstance().getPRegion(
+        mapper_result.second)->get_size();
+    if (FindInMapInterval(MappedPRs_, start, end - 1) == MappedPRs_.end())
+        InsertToMapInterval(&MappedPRs_, start, end, mapper_result.second);
+    return std::make_pair(start, end);
+}
+
+///
+/// Map every region touched by the log entries to be undone, so that
+/// the entries can then be undone in parallel without any region
+/// lookup. The pages to be written are gathered first: in address
+/// order, those of a region are contiguous, so a region is looked up
+/// once rather than once per log entry. The pages are then populated
+/// in parallel to take the page faults out of the undo.
+///
+void Recovery::mapRegions()
+{
+    std::vector<uint64_t> pages;
+    for (size_t i = 0; i < LogEntries_.size(); ++ i) {
+        LogEntry *le = LogEntries_[i];
+        if (!isReplayed(le)) continue;
+        // The targets of a batched free are collected one by one. The
+        // size of a pool log entry is a generation number, as is
+        // that of an allocation ordered after a free.
+        if (le->isFreeBatch()) {
+            size_t *buf = (size_t*)le->Addr;
+            for (size_t j = 1; j <= buf[0]; ++j)
+                collectPages(&pages, (void*)buf[j], sizeof(size_t));
+        }
+        else if (le->isPoolAlloc() || le->isPoolFree())
+            collectPages(&pages, le->Addr, 1);
+        else if (le->isAlloc() || le->isFree())
+            collectPages(&pages, le->Addr, sizeof(size_t));
+        else if (le->isStr()) collectPages(&pages, le->Addr, le->Size/8);
+        else collectPages(&pages, le->Addr, le->Size);
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    std::pair<uint64_t, uint64_t> rgn_range(0, 0);
+    for (size_t i = 0; i < pages.size(); ++ i)
+        if (pages[i] < rgn_range.first || pages[i] >= rgn_range.second)
+            rgn_range = ensureMapped((void*)pages[i]);
+
+    // Each thread populates a slice of the pages
+    uint32_t num_workers = getNumWorkers(pages.size() / kPrefaultMinPages);
+    std::vector<std::pair<const uint64_t*, const uint64_t*> >
+        slices(num_workers);
+    for (uint32_t i = 0; i < num_workers; ++ i) {
+        slices[i].first = pages.data() + pages.size() * i / num_workers;
+        slices[i].second = pages.data() + pages.size() * (i + 1) / num_workers;
+    }
+    std::vector<pthread_t> workers(num_workers - 1);
+    for (size_t i = 0; i < workers.size(); ++ i) {
+        int status = pthread_create(&workers[i], nullptr, prefaultPages,
+                                    &slices[i + 1]);
+        assert(!status);
+    }
+    prefaultPages(&slices[0]);
+    for (size_t i = 0; i < workers.size(); ++ i) {
+        int status = pthread_join(workers[i], nullptr);
+        assert(!status);
+    }
+}
+
+// Note the pages of a range written during the undo, skipping those
+// just noted
+void Recovery::collectPages(std::vector<uint64_t> *pages,
+                            void *addr, size_t sz)
+{
+    if (!sz) return;
+    uint64_t page = (uint64_t)addr & ~(kPageSize_ - 1);
+    uint64_t last_page = ((uint64_t)addr + sz - 1) & ~(kPageSize_ - 1);
+    for (; page <= last_page; page += kPageSize_)
+        if (pages->empty() || pages->back() != page)
+            pages->push_back(page);
+}
+
+// Populate writable the sorted pages of a slice, a run of adjacent
+// pages at a time. The contents of the pages are not changed.
+void *Recovery::prefaultPages(void *slice)
+{
+    std::pair<const uint64_t*, const uint64_t*> *range =
+        static_cast<std::pair<const uint64_t*, const uint64_t*>*>(slice);
+    const uint64_t *page = range->first;
+    while (page != range->second) {
+        const uint64_t *last = page;
+        while (last + 1 != range->second && last[1] == *last + kPageSize_)
+            ++ last;
+        char *start = (char*)*page;
+        size_t sz = *last + kPageSize_ - *page;
+        page = last + 1;
+#if defined(MADV_POPULATE_WRITE)
+        if (!madvise(start, sz, MADV_POPULATE_WRITE)) continue;
+#endif
+        // Older kernels: a read fault of a shared mapping without
+        // dirty tracking maps the page writable
+        for (char *p = start; p < start + sz; p += kPageSize_)
+            (void)*static_cast<volatile char*>(p);
+    }
+    return nullptr;
+}
+
+// Number of threads to share num_tasks among, the calling thread
+// being one of them
+uint32_t Recovery::getNumWorkers(size_t num_tasks)
+{
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return std::min(
+        std::min(kMaxRecoveryThreads, num_cpus > 0 ? (uint32_t)num_cpus : 1),
+        (uint32_t)std::max(std::min(num_tasks, (size_t)UINT32_MAX),
+                           (size_t)1));
+}
+
+// Note the cache lines of a range written during the undo
+void Recovery::collectCacheLines(std::vector<uint64_t> *dirty_lines,
+                                 void *addr, size_t sz)
+{
+    if (!sz) return;
+    uint64_t line = (uint64_t)addr & PMallocUtil::get_cache_line_mask();
+    uint64_t last_line = ((uint64_t)addr + sz - 1) &
+        PMallocUtil::get_cache_line_mask();
+    for (; line <= last_line; line += PMallocUtil::get_cache_line_size())
+        dirty_lines->push_back(line);
+}
+
+///
+/// Write back the cache lines noted by a worker, each one once and in
+/// address order, fencing only before and after the whole batch
+///
+void Recovery::flushCacheLines(std::vector<uint64_t> *dirty_lines)
+{
+    std::sort(dirty_lines->begin(), dirty_lines->end());
+    dirty_lines->erase(
+        std::unique(dirty_lines->begin(), dirty_lines->end()),
+        dirty_lines->end());
+    full_fence();
+    for (size_t i = 0; i < dirty_lines->size(); ++ i)
+        NVM_CLFLUSH((char*)(*dirty_lines)[i]);
+    full_fence();
+#if defined(_MSYNC_DURABILITY) && !defined(DISABLE_FLUSHES)
+    nvm_sync_dirty_pages();
+#endif
+    dirty_lines->clear();
+}
+
+void Recovery::replay(LogEntry *le, std::vector<uint64_t> *dirty_lines)
+{
+    assert(le);
+    assert(isReplayed(le));
+
+    void *addr = le->Addr;
+
+    if (le->isStr()) {
+        // TODO bit access is not supported?
+        assert(!(le->Size % 8));
+        memcpy(addr, (void*)&(le->ValueOrPtr), le->Size/8);
+        collectCacheLines(dirty_lines, addr, le->Size/8);
+    }
+    else if (le->isMemop() || le->isStrop()) {
+        assert(le->ValueOrPtr);
+        memcpy(addr, (void*)(le->ValueOrPtr), le->Size);
+        collectCacheLines(dirty_lines, addr, le->Size);
+    }
+    else if (le->isAlloc() || le->isFree()) {
+        // undo allocation or de-allocation
+        *((size_t*)addr) = le->isFree();
+        collectCacheLines(dirty_lines, addr, sizeof(size_t));
+    }
+    else if (le->isPoolAlloc() || le->isPoolFree()) {
+        // undo allocation or de-allocation
+        *((uint8_t*)addr) = le->isPoolFree();
+        collectCacheLines(dirty_lines, addr, 1);
+    }
+    else if (le->isAllocBatch()) {
+        // Undo every allocation in the run. If the headers did not
+        // all make it to memory, the run is beyond the bump pointer
+        // and the walk only touches unallocated memory.
+        char *mem = (char*)addr;
+        char *end = mem + le->Size;
+        while (mem + PMallocUtil::get_metadata_size() <= end) {
+            *((size_t*)(mem + sizeof(size_t))) = false;
+            collectCacheLines(dirty_lines, mem + sizeof(size_t),
+                              sizeof(size_t));
+            size_t actual_sz = PMallocUtil::get_actual_alloc_size(
+                *((size_t*)mem));
+            if (!actual_sz || actual_sz > (size_t)(end - mem)) break;
+            mem += actual_sz;
+        }
+    }
+    else if (le->isFreeBatch()) {
+        size_t *buf = (size_t*)addr;
+        for (size_t i = 1; i <= buf[0]; ++i) {
+            *((size_t*)buf[i]) = true;
+            collectCacheLines(dirty_lines, (void*)buf[i], sizeof(size_t));
+        }
+    }
+    else assert(0 && "Bad log entry type");
+    
+    ReplayedCount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Undo the log entries of a run, the last one in program order first
+void Recovery::replayNode(const RecoveryNode & node,
+                          std::vector<uint64_t> *dirty_lines)
+{
+    for (uint32_t i = node.Hi; i-- > node.Lo; ) {
+        LogEntry *le = LogEntries_[i];
+#ifdef _NVM_TRACE
+        fprintf(stderr,
+                "Replaying tid = %d le = %p, addr = %p, val = %ld Type = %s\n",
+                node.Tid, le, le->Addr, le->ValueOrPtr,
+                le->Type == LE_acquire ? "acq" :
+                le->Type == LE_release ? "rel" :
+                le->Type == LE_str ? "str" :
+                le->isMemset() ? "memset" :
+                le->isMemcpy() ? "memcpy" :
+                le->isMemmove() ? "memmove" :
+                le->isStrcpy() ? "strcpy" :
+                le->isStrcat() ? "strcat" : "don't-care");
+#endif
+        if (isReplayed(le)) replay(le, dirty_lines);
+    }
+}
+
+// A worker takes runs whose predecessors are all undone, undoes them
+// and hands their successors over once ready. Runs not ordered with
+// each other touch disjoint data in a well-synchronized program. The
+// cache lines written are flushed once the worker runs out of runs.
+void *Recovery::worker(void *dirty_lines)
+{
+    Recovery& rec = getInstance();
+    pthread_mutex_lock(&rec.ReadyLock_);
+    while (true) {
+        if (rec.ReadyNodes_.empty()) {
+            // Either all runs are undone, or what is left is stuck
+            if (!rec.NumBusyWorkers_) break;
+            pthread_cond_wait(&rec.ReadyCondition_, &rec.ReadyLock_);
+            continue;
+        }
+        uint32_t n = rec.ReadyNodes_.back();
+        rec.ReadyNodes_.pop_back();
+        ++ rec.NumBusyWorkers_;
+        pthread_mutex_unlock(&rec.ReadyLock_);
+
+        rec.replayNode(rec.Nodes_[n],
+                       static_cast<std::vector<uint64_t>*>(dirty_lines));
+
+        pthread_mutex_lock(&rec.ReadyLock_);
+        -- rec.NumBusyWorkers_;
+        ++ rec.NumDoneNodes_;
+        for (uint32_t i = rec.SuccOffsets_[n]; i < rec.SuccOffsets_[n + 1];
+             ++ i)
+            if (!-- rec.Nodes_[rec.Succs_[i]].NumPreds)
+                rec.ReadyNodes_.push_back(rec.Succs_[i]);
+        if (!rec.ReadyNodes_.empty() || !rec.NumBusyWorkers_)
+            pthread_cond_broadcast(&rec.ReadyCondition_);
+    }
+    pthread_mutex_unlock(&rec.ReadyLock_);
+
+    flushCacheLines(static_cast<std::vector<uint64_t>*>(dirty_lines));
+    return nullptr;
+}
+
+///
+/// Undo the runs on a pool of threads, in reverse happens-before order
+///
+void Recovery::undo()
+{
+    for (uint32_t n = 0; n < Nodes_.size(); ++ n)
+        if (!Nodes_[n].NumPreds) ReadyNodes_.push_back(n);
+
+    uint32_t num_workers = getNumWorkers(Nodes_.size());
+    std::vector<pthread_t> workers(num_workers - 1);
+    std::vector<std::vector<uint64_t> > dirty_lines(num_workers);
+    for (size_t i = 0; i < workers.size(); ++ i) {
+        int status = pthread_create(&workers[i], nullptr, worker,
+                                    &dirty_lines[i + 1]);
+        assert(!status);
+    }
+    worker(&dirty_lines[0]);
+    for (size_t i = 0; i < workers.size(); ++ i) {
+        int status = pthread_join(workers[i], nullptr);
+        assert(!status);
+    }
+    assert(NumDoneNodes_ == Nodes_.size() &&
+           "Cycle among the happens-before relations of the log!");
+    
+    if (DoesReport_) fprintf(
+        stderr,
+        "[Atlas] Done undoing %ld log entries in %ld runs on %d threads\n",
+        (long)ReplayedCount_.load(), (long)Nodes_.size(), (int)num_workers);
+}
+
+} // namespace Atlas
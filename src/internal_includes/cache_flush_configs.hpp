@@ -25,6 +25,8 @@ const int32_t kFlushTableSize = 8;
 const int32_t kFlushTableMask = kFlushTableSize - 1;
 // TODO the following should be derived from cache line size
 const uint32_t kFlushShift = 6; // log(cache line size)
+// A thread syncs its dirty pages early once it has recorded this many
+const uint32_t kMaxDirtyPages = 1024;
     
 } // namespace Atlas
 
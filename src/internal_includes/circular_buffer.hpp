@@ -56,6 +56,12 @@ struct CbLog
     }
 };
 
+// States of a circular buffer in the CbList
+const uint32_t kCbInUse = 0;
+const uint32_t kCbAvailable = 1; // got filled and then emptied
+const uint32_t kCbReclaiming = 2; // its pages are being returned to the OS
+const uint32_t kCbReclaimed = 3; // available, its pages were returned
+
 template<class T>
 struct CbListNode
 {
@@ -65,7 +71,7 @@ struct CbListNode
         EndAddr{end_addr},
         Next{nullptr},
         Tid{pthread_self()},
-        isAvailable{false} {}
+        isAvailable{kCbInUse} {}
     CbListNode() = delete;
     CbListNode(const CbListNode&) = delete;
     CbListNode(CbListNode&&) = delete;
@@ -85,6 +91,8 @@ struct CbListNode
 // creates a new buffer, adds it to the CbList and
 // return the first slot from this new buffer. If a buffer ever becomes
 // empty, it can be reused. A partially empty buffer cannot be reused.
+// The pages of a buffer that is not reused yet may be returned to the
+// OS in the meantime.
 
 // TODO eventual GC on cb_list
 
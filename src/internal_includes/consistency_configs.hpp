@@ -24,6 +24,8 @@
 namespace Atlas {
 
 const uint32_t kFaseAnalysisLimit = 8;
+// Used instead while the log is over budget, see _BOUNDED_RECOVERY
+const uint32_t kFaseAnalysisLimitOverBudget = 1024;
 
 } // namespace Atlas
     
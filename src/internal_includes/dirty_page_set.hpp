@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#ifndef DIRTY_PAGE_SET_HPP
+#define DIRTY_PAGE_SET_HPP
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "pregion_configs.hpp"
+#include "cache_flush_configs.hpp"
+
+namespace Atlas {
+
+// Pages of file-backed regions written since the last sync point of
+// a thread. With _MSYNC_DURABILITY, a cache line flush only records
+// its page here and the pages are made durable in address order with
+// as few msync calls as possible.
+class DirtyPageSet {
+public:
+    DirtyPageSet() : LastPage_{0} {}
+    ~DirtyPageSet() { sync(); }
+
+    DirtyPageSet(const DirtyPageSet&) = delete;
+    DirtyPageSet(DirtyPageSet&&) = delete;
+    DirtyPageSet& operator=(const DirtyPageSet&) = delete;
+    DirtyPageSet& operator=(DirtyPageSet&&) = delete;
+
+    void insert(const void *addr);
+    void sync();
+private:
+    std::vector<uintptr_t> Pages_;
+    uintptr_t LastPage_; // consecutive flushes often hit the same page
+
+    static void syncRange(uintptr_t start, uintptr_t end);
+};
+
+inline void DirtyPageSet::insert(const void *addr)
+{
+    uintptr_t page = reinterpret_cast<uintptr_t>(addr) & ~(kPageSize_ - 1);
+    if (page == LastPage_) return;
+    LastPage_ = page;
+    Pages_.push_back(page);
+    if (Pages_.size() >= kMaxDirtyPages) sync();
+}
+
+} // namespace Atlas
+
+#endif
@@ -125,6 +125,10 @@ private:
     void PrintStrOpLog(LogEntry *le);    
     void PrintAllocLog(LogEntry *le);
     void PrintFreeLog(LogEntry *le);
+    void PrintAllocBatchLog(LogEntry *le);
+    void PrintFreeBatchLog(LogEntry *le);
+    void PrintPoolAllocLog(LogEntry *le);
+    void PrintPoolFreeLog(LogEntry *le);
 };
     
 inline DGraph::VDesc DGraph::createNode(FASection *fase)
@@ -30,7 +30,11 @@ extern "C" {
     void nvm_rwlock_unlock(void *lock_address);
     void nvm_store(void *addr, size_t size);
     void nvm_log_alloc(void *addr);
-    void nvm_log_free(void *addr);
+    int nvm_log_free(void *addr);
+    void nvm_log_alloc_batch(void *addr, size_t sz);
+    int nvm_log_free_batch(void **addrs, size_t n);
+    void nvm_log_pool_alloc(void *addr);
+    void nvm_log_pool_free(void *addr);
     void nvm_memset(void *addr, size_t sz);
     void nvm_memcpy(void *dst, size_t sz);
     void nvm_memmove(void *dst, size_t sz);
@@ -47,6 +51,12 @@ extern "C" {
     void AsyncMemOpDataFlush(void *dst, size_t sz);
 #endif
 
+#if defined(_MSYNC_DURABILITY)
+    void nvm_note_dirty_log(const void *addr);
+    void nvm_sync_dirty_log_pages();
+    void nvm_sync_dirty_pages();
+#endif
+
     
 #ifdef __cplusplus
 }
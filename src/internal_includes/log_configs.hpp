@@ -28,14 +28,24 @@ const uint64_t kHashTableMask = kHashTableSize - 1;
 const uint32_t kShift = 3;
 const uint32_t kWorkThreshold = 100;
 const uint32_t kCircularBufferSize = 1024 * 16 - 1;
+// Period of the reclaimer, see _RECLAIM_MEMORY
+const uint32_t kReclaimIntervalMs = 1000;
+// Period of the stats page updates, see atlas_top
+const uint32_t kStatsPageIntervalMs = 100;
+// Log not pruned yet beyond which threads wait for the helper thread,
+// see _BOUNDED_RECOVERY. Recovery time is roughly proportional to it.
+const uint64_t kMaxOutstandingLogBytes = 64ULL << 20;
+// Longest a thread waits for a round of the helper thread
+const uint32_t kLogBudgetWaitMs = 100;
     
-// At limit for using 4 bits
+// Uses 5 bits in a log entry
 // Combined strncat and strcat, strcpy and strncpy
 enum LogType {
     LE_dummy, LE_acquire, LE_rwlock_rdlock, LE_rwlock_wrlock,
     LE_begin_durable, LE_release, LE_rwlock_unlock, LE_end_durable,
     LE_str, LE_memset, LE_memcpy, LE_memmove,
-    LE_strcpy, LE_strcat, LE_alloc, LE_free
+    LE_strcpy, LE_strcat, LE_alloc, LE_free,
+    LE_alloc_batch, LE_free_batch, LE_pool_alloc, LE_pool_free
 };
 
 } // namespace Atlas
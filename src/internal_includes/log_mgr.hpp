@@ -37,6 +37,7 @@
 #include "circular_buffer.hpp"
 #include "log_elision.hpp"
 #include "stats.hpp"
+#include "stats_page.hpp"
 
 #include "util.hpp"
 
@@ -129,8 +130,10 @@ public:
     void logMemmove(void *dst, size_t sz);
     void logStrcpy(void *dst, size_t sz);
     void logStrcat(void *dst, size_t sz);
-    void logAlloc(void *addr);
-    void logFree(void *addr);
+    void logAlloc(void *addr, LogType le_type = LE_alloc);
+    bool logFree(void *addr, LogType le_type = LE_free);
+    void logAllocBatch(void *addr, size_t sz);
+    bool logFreeBatch(void **addrs, size_t n);
 
     LogStructure *createLogStructure(LogEntry *le);
 
@@ -168,6 +171,26 @@ public:
     void deleteEntry(LogEntry *addr)
         { deleteEntry<LogEntry>(CbLogList_, addr); }
 
+    // Returning freed memory to the OS
+    void startReclaimer();
+    void stopReclaimer();
+    size_t reclaimLogBuffers();
+    uint64_t get_reclaimed_bytes() const
+        { return ReclaimedBytes_.load(std::memory_order_relaxed); }
+
+    // Publishing the stats page
+    void startStatsPublisher();
+    void stopStatsPublisher();
+
+    // Consistent cut for region snapshots
+    bool pauseFases(uint32_t timeout_ms);
+    void resumeFases();
+
+    // Bound on the log outstanding, see _BOUNDED_RECOVERY
+    void notePrunedLogEntries(uint64_t num_pruned);
+    bool isLogOverBudget() const
+        { return isOverLogBudget(kMaxOutstandingLogBytes / 2); }
+
     void acquireStatsLock()
         { assert(Stats_); Stats_->acquireLock(); }
     void releaseStatsLock()
@@ -222,6 +245,41 @@ private:
     Stats *Stats_;
 
     bool IsInitialized_;
+
+    // Thread returning freed memory to the OS periodically, woken up
+    // early only to stop
+    pthread_t ReclaimerThread_;
+    pthread_cond_t ReclaimerCondition_;
+    pthread_mutex_t ReclaimerLock_;
+    bool IsReclaimerDone_;
+    std::atomic<uint64_t> ReclaimedBytes_;
+
+    // Thread updating the stats page every kStatsPageIntervalMs
+    pthread_t StatsPublisherThread_;
+    pthread_cond_t StatsPublisherCondition_;
+    pthread_mutex_t StatsPublisherLock_;
+    bool IsStatsPublisherDone_;
+    StatsPage *StatsPage_;
+
+    // Failure-atomic sections in progress, and whether new ones are
+    // held back at their start while a region snapshot is taken
+    std::atomic<uint32_t> NumActiveFases_;
+    std::atomic<bool> AreFasesPaused_;
+    pthread_cond_t FaseGateCondition_;
+    pthread_mutex_t FaseGateLock_;
+
+    // Log entries created as published by the user threads, and log
+    // entries pruned as of the last round of the helper thread. Their
+    // difference is the log a recovery would have to go through.
+    // Threads over budget wait for the helper thread at the end of a
+    // failure-atomic section.
+    std::atomic<uint64_t> NumLoggedEntries_;
+    std::atomic<uint64_t> NumPrunedEntries_;
+    // Protected by LogBudgetLock_
+    uint64_t HelperRoundNum_;
+    uint64_t LastRoundPruned_;
+    pthread_cond_t LogBudgetCondition_;
+    pthread_mutex_t LogBudgetLock_;
     
     //
     // Start of thread local members
@@ -270,6 +328,14 @@ private:
     // Total number of logs created by this thread
     thread_local static uint64_t TL_LogCounter_;
 
+    // Part of the above added to NumLoggedEntries_ so far
+    thread_local static uint64_t TL_PublishedLogCounter_;
+
+    // Time stamp counter and num_flushes when the current outermost
+    // FASE started, for the FASE histograms
+    thread_local static uint64_t TL_FaseStartCycles_;
+    thread_local static uint64_t TL_FaseStartFlushes_;
+
     // Set of cache lines that need to be flushed at end of FASE
     thread_local static SetOfInts *TL_FaseFlushPtr_;
 
@@ -294,10 +360,28 @@ private:
         RecoveryTimeLsp_{nullptr},
         AllDone_{0},
         Stats_{nullptr},
-        IsInitialized_{false}
+        IsInitialized_{false},
+        IsReclaimerDone_{false},
+        ReclaimedBytes_{0},
+        IsStatsPublisherDone_{false},
+        StatsPage_{nullptr},
+        NumActiveFases_{0},
+        AreFasesPaused_{false},
+        NumLoggedEntries_{0},
+        NumPrunedEntries_{0},
+        HelperRoundNum_{0},
+        LastRoundPruned_{0}
         {
             pthread_cond_init(&HelperCondition_, nullptr);
             pthread_mutex_init(&HelperLock_, nullptr);
+            pthread_cond_init(&ReclaimerCondition_, nullptr);
+            pthread_mutex_init(&ReclaimerLock_, nullptr);
+            pthread_cond_init(&StatsPublisherCondition_, nullptr);
+            pthread_mutex_init(&StatsPublisherLock_, nullptr);
+            pthread_cond_init(&FaseGateCondition_, nullptr);
+            pthread_mutex_init(&FaseGateLock_, nullptr);
+            pthread_cond_init(&LogBudgetCondition_, nullptr);
+            pthread_mutex_init(&LogBudgetLock_, nullptr);
         }
 
     ~LogMgr()
@@ -310,6 +394,9 @@ private:
 
     void init();
     void finalize();
+#if defined(_IN_PROCESS_RECOVERY)
+    void recoverInProcess(const char *log_name);
+#endif
 
     // Given a lock address, get a pointer to the bucket for the last
     // release 
@@ -329,6 +416,10 @@ private:
         void *lock_address, LogType le_type);
     LogEntry *createAllocationLogEntry(
         void *addr, LogType le_type);
+    LogEntry *createAllocBatchLogEntry(
+        void *addr, size_t sz);
+    LogEntry *createFreeBatchLogEntry(
+        void **addrs, size_t n);
     LogEntry *createStrLogEntry(
         void * addr, size_t size_in_bits);
     LogEntry *createMemStrLogEntry(
@@ -346,6 +437,11 @@ private:
         LogEntry *le);
     void finishWrite(
         LogEntry * le, void * addr);
+    void enterFase();
+    void exitFase();
+    void publishLogCount();
+    bool isOverLogBudget(uint64_t budget_bytes) const;
+    void waitForLogBudget();
     void assertOneCacheLine(LogEntry *le) {
 #if !defined(_LOG_WITH_NVM_ALLOC) && !defined(_LOG_WITH_MALLOC)
     // The entire log entry must be on the same cache line
@@ -399,6 +495,9 @@ private:
     template<class T> void deleteSlot(
         CbLog<T> *cb, T *addr);
 
+    static void *reclaimer(void*);
+    static void *statsPublisher(void*);
+
 };
 
 inline void LogMgr::logAcquire(void *lock_address)
@@ -501,6 +600,9 @@ inline void LogMgr::flushLogUncond(void *p)
 #if defined(_LOG_FLUSH_OPT)
     // TODO: this needs more work. It is incomplete.
     AsyncLogFlush(p);
+#elif defined(_MSYNC_DURABILITY)
+    // Synced when the log entry is published
+    nvm_note_dirty_log(p);
 #else
     NVM_FLUSH(p);
 #endif
@@ -39,8 +39,8 @@ struct LogEntry
     void *Addr; /* address of mloc or lock object */
     uintptr_t ValueOrPtr; /* either value or ptr (for sync ops) */
     std::atomic<LogEntry*> Next; /* ptr to next log entry in program order */
-    size_t Size:60; /* mloc size or a generation # for sync ops */
-    LogType Type:4;
+    size_t Size:59; /* mloc size or a generation # for sync ops */
+    LogType Type:5;
 
     bool isDummy() const { return Type == LE_dummy; }
     bool isAcquire() const { return Type == LE_acquire; }
@@ -59,6 +59,14 @@ struct LogEntry
     }
     bool isAlloc() const { return Type == LE_alloc; }
     bool isFree() const { return Type == LE_free; }
+    bool isAllocBatch() const { return Type == LE_alloc_batch; }
+    bool isFreeBatch() const { return Type == LE_free_batch; }
+    bool isPoolAlloc() const { return Type == LE_pool_alloc; }
+    bool isPoolFree() const { return Type == LE_pool_free; }
+    bool isAllocation() const
+        { return isAlloc() || isAllocBatch() || isPoolAlloc(); }
+    bool isDeallocation() const
+        { return isFree() || isFreeBatch() || isPoolFree(); }
     bool isStrcpy() const { return Type == LE_strcpy; }
     bool isStrcat() const { return Type == LE_strcat; }
     bool isStrop() const { return Type == LE_strcpy || Type == LE_strcat; }
@@ -163,6 +171,26 @@ static inline bool isFree(LogType le_type)
 {
     return le_type == LE_free;
 }
+
+static inline bool isAllocBatch(LogType le_type)
+{
+    return le_type == LE_alloc_batch;
+}
+
+static inline bool isFreeBatch(LogType le_type)
+{
+    return le_type == LE_free_batch;
+}
+
+static inline bool isPoolAlloc(LogType le_type)
+{
+    return le_type == LE_pool_alloc;
+}
+
+static inline bool isPoolFree(LogType le_type)
+{
+    return le_type == LE_pool_free;
+}
     
 static inline bool isStrcpy(LogType le_type)
 {
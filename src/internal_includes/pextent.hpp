@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+
+#ifndef PEXTENT_HPP
+#define PEXTENT_HPP
+
+#include <cstdlib>
+#include <cassert>
+#include <map>
+#include <vector>
+#include <utility>
+
+#include <pthread.h>
+
+#include "pregion_configs.hpp"
+
+#include "atlas_api.h"
+
+namespace Atlas {
+
+// Persistent descriptor of an extent. As for a chunk header, undoing
+// an allocation or deallocation only touches IsAllocated_.
+struct PExtent {
+    void *Addr_;
+    size_t Size_; // requested size
+    size_t IsAllocated_;
+    size_t Unused_; // a cache line holds a whole number of descriptors
+};
+
+// Logically transient bookkeeping of an extent arena, rebuilt from
+// the descriptor table every time the region is mapped
+struct PExtentTransients {
+    std::map<char* /* start */, size_t /* length */> FreeRanges_;
+    // Free ranges known to read as zero, a subset of FreeRanges_
+    std::map<char* /* start */, size_t /* length */> ZeroRanges_;
+    std::map<void* /* extent */, uint32_t /* descriptor */> Alloced_;
+    std::vector<uint32_t /* descriptor */> FreeDescs_;
+    // Descriptors whose free is logged but not yet committed, and
+    // whether the pages can still be returned to the OS at commit time
+    std::map<uint32_t /* descriptor */, bool /* can punch */> PendingFrees_;
+};
+
+// Physically persistent allocator for large objects, contains
+// logically transient data as well. Extents are page aligned, and
+// huge page aligned if at least that large, so they can be backed by
+// huge pages and returned to the OS on free.
+class PExtentArena {
+public:
+    explicit PExtentArena() : StartAddr_{nullptr}, EndAddr_{nullptr},
+        MaxNumExtents_{0}, ActualAlloced_{0}, ZeroAddr_{nullptr},
+        FileDesc_{-1}, PunchAlign_{kPageSize_}, Transients_{nullptr}
+        { pthread_mutex_init(&Lock_, NULL); }
+
+    ~PExtentArena()
+        { if (Transients_) { delete Transients_; Transients_ = nullptr; } }
+
+    PExtentArena(const PExtentArena&) = delete;
+    PExtentArena(PExtentArena&&) = delete;
+    PExtentArena& operator=(const PExtentArena&) = delete;
+    PExtentArena& operator=(PExtentArena&&) = delete;
+
+    void initAllocAddresses(void *start_addr, uint64_t sz);
+    void initTransients(int fd);
+    void resetTransients()
+        { delete Transients_; Transients_ = nullptr;
+            initTransients(FileDesc_); }
+
+    void *get_start_addr() const { return StartAddr_; }
+    void *get_end_addr() const { return EndAddr_; }
+    uint64_t get_actual_alloced() const { return ActualAlloced_; }
+    size_t get_punch_align() const { return PunchAlign_; }
+
+    bool doesRangeCheck(const void *ptr) const
+        { return ptr >= StartAddr_ && ptr < EndAddr_; }
+    bool isDescriptor(const void *addr) const
+        { return addr >= StartAddr_ &&
+                addr < static_cast<void*>(getExtent(MaxNumExtents_)); }
+
+    void *allocMem(size_t sz, bool does_need_logging, size_t min_align = 0,
+                   bool *is_zeroed = nullptr);
+    void freeMem(void *ptr, bool should_log);
+    bool reallocInPlace(void *ptr, size_t sz, bool does_need_logging);
+    void completeFree(void *is_allocated_addr);
+    size_t getAllocSize(void *ptr);
+    void getPopulatedRanges(std::vector<std::pair<char*, size_t> > *ranges);
+    void getWrittenRanges(
+        std::vector<std::pair<char*, size_t> > *ranges) const;
+
+    void Lock() { pthread_mutex_lock(&Lock_); }
+    void Unlock() { pthread_mutex_unlock(&Lock_); }
+
+    static size_t get_extent_alignment(size_t sz)
+        { return sz >= kHugePageSize_ ? kHugePageSize_ : kPageSize_; }
+    static size_t get_extent_size(size_t sz)
+        { return (sz + get_extent_alignment(sz) - 1) &
+                ~(get_extent_alignment(sz) - 1); }
+
+private:
+    // The following are persistent. Their updates are flushed but not
+    // logged. The descriptor table is at StartAddr_ and has one entry
+    // per kExtentThreshold_ bytes of the arena.
+    void *StartAddr_;
+    void *EndAddr_;
+    uint32_t MaxNumExtents_;
+
+    // Persistent, updated only under the stats flag
+    uint64_t ActualAlloced_;
+
+    // Persistent. No extent was ever handed out at or beyond this
+    // address, or beyond the descriptor table if null. Its update is
+    // flushed but not logged.
+    void *ZeroAddr_;
+
+    // The following are considered logically transient and hence not
+    // flushed. They must be reset at init time.
+    pthread_mutex_t Lock_;
+    int FileDesc_;
+    size_t PunchAlign_; // block size of the backing file system
+    PExtentTransients *Transients_;
+
+    void flushDirtyCacheLines()
+        { NVM_FLUSH(&StartAddr_); NVM_FLUSH(&MaxNumExtents_);
+            NVM_FLUSH(&ActualAlloced_); }
+
+    PExtent *getExtent(uint32_t index) const
+        { return static_cast<PExtent*>(StartAddr_) + index; }
+    // Extents start past the descriptor table, on a huge page boundary
+    char *get_first_extent_addr() const
+        { return static_cast<char*>(StartAddr_) +
+                ((MaxNumExtents_ * sizeof(PExtent) + kHugePageSize_ - 1) &
+                 ~(kHugePageSize_ - 1)); }
+
+    uint32_t findExtent(void *ptr) const;
+    void insertFreeRange(char *start, size_t sz)
+        { insertRange(&Transients_->FreeRanges_, start, sz); }
+    static void insertRange(
+        std::map<char*, size_t> *ranges, char *start, size_t sz);
+    static void eraseRange(
+        std::map<char*, size_t> *ranges, char *start, size_t sz);
+    bool isZeroRange(char *start, size_t sz) const;
+    void cancelPendingPunches(char *start, size_t sz);
+    bool punchHole(void *addr, size_t sz) const;
+
+    void incrementActualAllocedStats(size_t sz);
+    void decrementActualAllocedStats(size_t sz);
+};
+
+inline void PExtentArena::initAllocAddresses(void *start_addr, uint64_t sz)
+{
+    StartAddr_ = start_addr;
+    EndAddr_ = static_cast<void*>(static_cast<char*>(start_addr) + sz);
+    MaxNumExtents_ = sz / kExtentThreshold_;
+    flushDirtyCacheLines();
+}
+
+inline void PExtentArena::incrementActualAllocedStats(size_t sz)
+{
+#if defined(ATLAS_ALLOC_STATS)
+    ActualAlloced_ += sz;
+    NVM_FLUSH(&ActualAlloced_);
+#endif
+}
+
+inline void PExtentArena::decrementActualAllocedStats(size_t sz)
+{
+#if defined(ATLAS_ALLOC_STATS)
+    ActualAlloced_ -= sz;
+    NVM_FLUSH(&ActualAlloced_);
+#endif
+}
+
+} // namespace Atlas
+
+#endif
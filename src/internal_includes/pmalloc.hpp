@@ -23,40 +23,70 @@
 #include <cstdlib>
 #include <cassert>
 #include <map>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <cerrno>
 
 #include <pthread.h>
 
 #include "pregion_configs.hpp"
+#include "stats.hpp"
 
 #include "atlas_api.h"
 
 namespace Atlas {
     
-typedef std::map<void* /* chunk address */, bool /* dummy */> MemMap;
+// A chunk is reclaimed once the whole pages of its body were returned
+// to the OS and the rest of the body was cleared, it then reads as zero
+typedef std::map<void* /* chunk address */, bool /* is reclaimed */> MemMap;
 typedef std::map<uint32_t /* bin number */, MemMap> FreeList;
+typedef std::map<void* /* chunk address */, uint32_t /* count */>
+PendingFreeMap;
 
-// Physically persistent arena, contains logically transient data as well
+// Link of a remote-free queue, kept in the body of the queued chunk
+struct RemoteFree {
+    RemoteFree *Next_;
+    bool IsLogged_;
+};
+
+// Epoch of arena transients that were never set up
+const uint64_t kNoArenaEpoch_ = 0;
+
+// Physically persistent arena, contains logically transient data as
+// well. The transients are set up on first use, they are valid only
+// if Epoch_ matches the epoch of the current mapping of the region.
 class PArena {
 public:
     explicit PArena() : CurrAllocAddr_{nullptr}, StartAddr_{nullptr},
-        EndAddr_{nullptr}, ActualAlloced_{0}, FreeList_{new FreeList}
-        { pthread_mutex_init(&Lock_, NULL); flushDirtyCacheLines(); }
+        EndAddr_{nullptr}, ActualAlloced_{0}, FreeList_{nullptr},
+        PendingFrees_{nullptr}, ContentionCount_{0}, RemoteFrees_{nullptr},
+        NumRemoteFrees_{0}, Epoch_{kNoArenaEpoch_}
+        { flushDirtyCacheLines(); }
     
-    ~PArena()
-        { if (FreeList_) { delete FreeList_; FreeList_ = nullptr; } }
+    // Transients are released through destroyTransients
+    ~PArena() = default;
 
     PArena(const PArena&) = delete;
     PArena(PArena&&) = delete;
     PArena& operator=(const PArena&) = delete;
     PArena& operator=(PArena&&) = delete;
     
-    void initAllocAddresses(void *start_addr);
-    void initTransients();
+    void initAllocAddresses(void *start_addr, uint64_t sz);
+    void ensureTransients(uint64_t epoch)
+        { if (Epoch_.load(std::memory_order_acquire) != epoch)
+                initTransients(epoch); }
+    void destroyTransients(uint64_t epoch);
+    bool hasTransients(uint64_t epoch) const
+        { return Epoch_.load(std::memory_order_acquire) == epoch; }
     
     void *get_curr_alloc_addr() const { return CurrAllocAddr_; }
     void *get_start_addr() const { return StartAddr_; }
     void *get_end_addr() const { return EndAddr_; }
+    void *get_dirty_end_addr() const { return DirtyEndAddr_; }
     uint64_t get_actual_alloced() const { return ActualAlloced_; }
+    uint64_t get_contention_count() const
+        { return ContentionCount_.load(std::memory_order_relaxed); }
     
     bool doesRangeCheck(void *start, size_t sz) const
         { return start >= StartAddr_ &&
@@ -65,19 +95,30 @@ public:
 
     void *allocMem(
         size_t sz, bool does_need_cache_line_alignment,
-        bool does_need_logging);
+        bool does_need_logging, bool *is_zeroed = nullptr);
     void *allocFromFreeList(
         size_t sz, bool does_need_cache_line_alignment,
-        bool does_need_logging);
+        bool does_need_logging, bool *is_zeroed = nullptr);
     void *allocFromUpdatedFreeList(
         size_t sz, bool does_need_cache_line_alignment,
         bool does_need_logging);
     void *allocRawMem(size_t);
+    size_t allocMemBatch(
+        const size_t *sizes, size_t n, void **out, bool does_need_logging);
+    bool reallocInPlace(void *ptr, size_t sz, bool does_need_logging);
 
     void freeMem(void *ptr, bool should_log);
+    void freeRemoteMem(void *ptr, bool should_log);
+    void freeMemBatch(void *const *ptrs, size_t n, bool is_logged);
+    bool hasRemoteFrees() const
+        { return RemoteFrees_.load(std::memory_order_relaxed) != nullptr; }
+    void drainRemoteFrees();
+    void completeFree(void *mem);
+    size_t reclaimFreeMem(int fd, void *file_start, size_t punch_align);
+    void getAllocatedRanges(std::vector<std::pair<char*, size_t> > *ranges);
 
-    void Lock() { pthread_mutex_lock(&Lock_); }
-    int tryLock() { return pthread_mutex_trylock(&Lock_); }
+    void Lock();
+    int tryLock();
     void Unlock() { pthread_mutex_unlock(&Lock_); }
     
 private:
@@ -94,36 +135,105 @@ private:
     // This field is unconditionally included here to avoid
     // layout incompatibility but updated only under the stats flag.
     uint64_t ActualAlloced_;
+
+    // Persistent as well. Bump space below this address may hold
+    // chunk headers written by a batch allocation that failed before
+    // moving the bump pointer. Bump space at or beyond it reads as
+    // zero. Its update is flushed but not logged.
+    void *DirtyEndAddr_;
     
     // The following are considered logically transient and hence not
     // flushed. They must be reset at init time.
     pthread_mutex_t Lock_;
     FreeList *FreeList_;
+    // Chunks whose free is logged but not yet committed. They cannot
+    // be reclaimed since undoing the free needs their contents.
+    PendingFreeMap *PendingFrees_;
+    std::atomic<uint64_t> ContentionCount_; // times Lock_ was found busy
+    // Chunks freed by threads not owning this arena, pushed without
+    // Lock_ and moved to FreeList_ by the next thread holding Lock_.
+    // A lock holder that sees a chunk free must drain before adding
+    // the chunk to FreeList_, the chunk may still be queued.
+    std::atomic<RemoteFree*> RemoteFrees_;
+    std::atomic<uint32_t> NumRemoteFrees_;
+    // Epoch the above were set up in, or that epoch plus one while
+    // they are being set up
+    std::atomic<uint64_t> Epoch_;
 
     void flushDirtyCacheLines()
         { NVM_FLUSH(&CurrAllocAddr_); NVM_FLUSH(&ActualAlloced_); }
     
+    void initTransients(uint64_t epoch);
+
     void *carveExtraMem(char *mem, size_t actual_sz, size_t actual_free_sz);
+    void *carveLoggedTail(char *mem, size_t actual_alloc_sz,
+                          size_t actual_sz, bool does_need_logging);
+    void resizeChunk(char *mem, size_t sz, bool does_need_logging);
+    static void flushChunkHeaders(void *const *ptrs, size_t n);
+    static void clearRange(char *start, size_t sz);
             
-    void insertToFreeList(uint32_t bin_no, void *mem);
+    void insertToFreeList(uint32_t bin_no, void *mem,
+                          bool is_reclaimed = false);
+    void notePendingFree(void *mem);
     void deleteFromFreeList(uint32_t bin_no, void *mem);
+    void pushRemoteFree(RemoteFree *node);
 
     void incrementActualAllocedStats(size_t sz);
     void decrementActualAllocedStats(size_t sz);
 };
 
-inline void PArena::initAllocAddresses(void *start_addr)
+inline void PArena::initAllocAddresses(void *start_addr, uint64_t sz)
 {
-    StartAddr_ = CurrAllocAddr_ = start_addr;
-    EndAddr_ = static_cast<void*>(
-        static_cast<char*>(start_addr) + kArenaSize_);
+    StartAddr_ = CurrAllocAddr_ = DirtyEndAddr_ = start_addr;
+    EndAddr_ = static_cast<void*>(static_cast<char*>(start_addr) + sz);
     flushDirtyCacheLines();
+    NVM_FLUSH(&DirtyEndAddr_);
+}
+
+///
+/// Release the transients if they were set up in the given epoch. No
+/// other thread may be using the arena.
+///
+inline void PArena::destroyTransients(uint64_t epoch)
+{
+    if (!hasTransients(epoch)) return;
+    delete FreeList_;
+    FreeList_ = nullptr;
+    delete PendingFrees_;
+    PendingFrees_ = nullptr;
+    // Queued chunks are marked free, a free list update finds them
+    RemoteFrees_.store(nullptr, std::memory_order_relaxed);
+    pthread_mutex_destroy(&Lock_);
+    Epoch_.store(kNoArenaEpoch_, std::memory_order_release);
+}
+
+inline void PArena::pushRemoteFree(RemoteFree *node)
+{
+    RemoteFree *head = RemoteFrees_.load(std::memory_order_relaxed);
+    do {
+        node->Next_ = head;
+    }while (!RemoteFrees_.compare_exchange_weak(
+                head, node,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+inline void PArena::Lock()
+{
+    if (pthread_mutex_trylock(&Lock_)) {
+        ContentionCount_.fetch_add(1, std::memory_order_relaxed);
+        StatsRegistry::increment(kArenaLockWaitCount);
+        pthread_mutex_lock(&Lock_);
+    }
 }
 
-inline void PArena::initTransients()
+inline int PArena::tryLock()
 {
-    pthread_mutex_init(&Lock_, NULL);
-    FreeList_ = new FreeList; 
+    int status = pthread_mutex_trylock(&Lock_);
+    if (status == EBUSY) {
+        ContentionCount_.fetch_add(1, std::memory_order_relaxed);
+        StatsRegistry::increment(kArenaLockWaitCount);
+    }
+    return status;
 }
 
 inline void PArena::incrementActualAllocedStats(size_t sz)
@@ -19,12 +19,20 @@
 #ifndef PMALLOC_UTIL_HPP
 #define PMALLOC_UTIL_HPP
 
+#include <cstring>
+
+#include <sched.h>
+#include <sys/types.h>
+#include <emmintrin.h>
+
+#include "atlas_api.h"
+
 namespace Atlas {
 
 class PMallocUtil {
 public:
     static void set_default_tl_curr_arena(region_id_t rid)
-        { TL_CurrArena_[rid] = kNumArenas_; /* set to invalid */}
+        { TL_CurrArena_[rid] = kMaxNumArenas_; /* set to invalid */}
     
     static void set_tl_curr_arena(region_id_t rid, uint32_t val)
         { TL_CurrArena_[rid] = val; }
@@ -32,11 +40,31 @@ public:
     static uint32_t get_tl_curr_arena(region_id_t rid)
         { return TL_CurrArena_[rid]; }
 
-    static uint32_t get_tl_next_arena(region_id_t rid)
-        { return (get_tl_curr_arena(rid) + 1) % kNumArenas_; }
+    static uint32_t get_tl_next_arena(region_id_t rid, uint32_t num_arenas)
+        { return (get_tl_curr_arena(rid) + 1) % num_arenas; }
     
     static bool is_valid_tl_curr_arena(region_id_t rid)
-        { return TL_CurrArena_[rid] != kNumArenas_; }
+        { return TL_CurrArena_[rid] != kMaxNumArenas_; }
+
+    static uint64_t get_next_arena_epoch();
+
+    static bool punch_hole(int fd, off_t offset, void *addr, size_t sz);
+
+    static uint32_t get_cpu_arena(uint32_t num_arenas);
+
+    static void set_num_numa_nodes(uint32_t n)
+        { NumNumaNodes_ = !n ? 1 : n > kMaxNumArenas_ ? kMaxNumArenas_ : n; }
+
+    static uint32_t get_num_numa_nodes()
+        { return NumNumaNodes_; }
+
+    // The arenas of a region are partitioned into contiguous, equally
+    // sized groups, one per NUMA node
+    static uint32_t get_first_arena_of_node(uint32_t node, uint32_t num_arenas)
+        { return node * num_arenas / NumNumaNodes_; }
+
+    static uint32_t get_numa_node_of_arena(uint32_t arena, uint32_t num_arenas)
+        { return (arena * NumNumaNodes_ + NumNumaNodes_ - 1) / num_arenas; }
             
     static void set_cache_line_size(uint32_t sz)
         { CacheLineSize_ = sz; }
@@ -120,12 +148,88 @@ public:
                 (sz + get_alignment_mask()) & ~get_alignment_mask() :
                 kMaxFreeCategory_;
         }
+
+    static void zero_mem(void *p, size_t sz);
+
+    // Write back the cache line holding p without a fence. Since
+    // clflush is ordered with respect to earlier and later stores and
+    // to other clflushes, a sequence of metadata updates flushed this
+    // way persists in program order and needs only a single
+    // drain_flushes at the end. The compiler must not move stores
+    // across the flush either.
+    static void flush_line(const void *p)
+        {
+            __asm__ __volatile__ ("" ::: "memory");
+            NVM_CLFLUSH(p);
+            __asm__ __volatile__ ("" ::: "memory");
+        }
+
+    // Complete the preceding flush_line calls
+    static void drain_flushes()
+        {
+#if !defined(DISABLE_FLUSHES)
+            full_fence();
+#endif
+        }
 private:
     static uint32_t CacheLineSize_;
+    static uint32_t NumNumaNodes_;
     static uintptr_t CacheLineMask_;
-    static thread_local uint32_t TL_CurrArena_[kMaxNumPRegions_];
+    static thread_local uint8_t TL_CurrArena_[kMaxNumPRegions_];
 };
 
+///
+/// Arena, out of num_arenas, to be used by the calling thread given
+/// the cpu it is currently running on. With _ARENA_NUMA, the choice
+/// is restricted to the arenas backed by the local NUMA node.
+///
+inline uint32_t PMallocUtil::get_cpu_arena(uint32_t num_arenas)
+{
+#if defined(_ARENA_NUMA)
+    unsigned int cpu, node;
+    if (getcpu(&cpu, &node)) return 0;
+    node %= NumNumaNodes_;
+    uint32_t first = get_first_arena_of_node(node, num_arenas);
+    uint32_t count = get_first_arena_of_node(node + 1, num_arenas) - first;
+    // Nodes share an arena if there are fewer arenas than nodes
+    return count ? first + cpu % count : first;
+#else
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : static_cast<uint32_t>(cpu) % num_arenas;
+#endif
+}
+
+///
+/// Clear memory being recycled. Large ranges are written with
+/// non-temporal stores, which neither pollute the cache nor need a
+/// later flush.
+///
+inline void PMallocUtil::zero_mem(void *p, size_t sz)
+{
+    if (sz < kNonTemporalZeroThreshold_) {
+        memset(p, 0, sz);
+        return;
+    }
+    char *start = static_cast<char*>(p);
+    char *end = start + sz;
+    char *aligned_start = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(start) + 15) & ~uintptr_t(15));
+    char *aligned_end = reinterpret_cast<char*>(
+        reinterpret_cast<uintptr_t>(end) & ~uintptr_t(15));
+    memset(start, 0, aligned_start - start);
+    const __m128i zero = _mm_setzero_si128();
+    for (char *q = aligned_start; q < aligned_end; q += 16)
+        _mm_stream_si128(reinterpret_cast<__m128i*>(q), zero);
+    memset(aligned_end, 0, end - aligned_end);
+    // Order the streaming stores before any later store
+    _mm_sfence();
+#if defined(_MSYNC_DURABILITY)
+    // Streamed pages are never flushed, so record them here
+    for (char *q = start; q < end; q += kPageSize_) nvm_note_dirty(q);
+    nvm_note_dirty(end - 1);
+#endif
+}
+
 } // namespace Atlas
     
 #endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+
+#ifndef PPOOL_HPP
+#define PPOOL_HPP
+
+#include <cstdint>
+#include <cassert>
+#include <atomic>
+
+#include "pregion_configs.hpp"
+
+namespace Atlas {
+
+class PRegion;
+class PPool;
+struct PPoolMagazine;
+
+// Header at the start of every slab of a pool. It is followed by one
+// state byte per object and then by the objects themselves.
+struct PPoolSlab {
+    PPool *Pool_;
+    PPoolSlab *Next_;
+
+    uint8_t *get_states()
+        { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+// Physically persistent descriptor of a pool of fixed-size objects.
+// Objects carry no header: a slab is aligned to its size, so the
+// state byte of an object is found from its address alone. Undoing an
+// allocation or deallocation only touches that byte.
+class PPool {
+public:
+    // An object reserved in the magazine of a thread is free as far
+    // as a later process is concerned
+    enum ObjState : uint8_t { kFree_ = 0, kAllocated_ = 1, kReserved_ = 2 };
+
+    explicit PPool(region_id_t rid, size_t obj_size, size_t align);
+
+    PPool(const PPool&) = delete;
+    PPool(PPool&&) = delete;
+    PPool& operator=(const PPool&) = delete;
+    PPool& operator=(PPool&&) = delete;
+
+    region_id_t get_region_id() const { return RegionId_; }
+    size_t get_obj_size() const { return Stride_; }
+
+    void *allocMem(PRegion *rgn);
+    void freeMem(void *ptr);
+    void releaseObjs(void *const *ptrs, size_t n);
+
+private:
+    // The following are persistent. They are written once, when the
+    // pool is created.
+    region_id_t RegionId_;
+    uint32_t NumObjs_; // per slab
+    size_t Stride_;
+    size_t ObjOffset_; // of the first object in a slab
+
+    // Persistent, slabs are only ever added at the head
+    std::atomic<PPoolSlab*> Slabs_;
+
+    // Identifies the process that last released the objects reserved
+    // by earlier processes. Not flushed: losing it only means the
+    // release is done again.
+    std::atomic<uint64_t> Epoch_;
+
+    PPoolSlab *get_slab(void *ptr) const
+        { return reinterpret_cast<PPoolSlab*>(
+              reinterpret_cast<uintptr_t>(ptr) & ~(kPoolSlabSize_ - 1)); }
+    void *get_obj(PPoolSlab *slab, uint32_t index) const
+        { return reinterpret_cast<char*>(slab) + ObjOffset_ +
+                index * Stride_; }
+    uint8_t *get_state(void *ptr) const;
+
+    void ensureEpoch();
+    PPoolSlab *allocSlab(PRegion *rgn);
+    void reserveObjs(PPoolSlab *slab, PPoolMagazine *mag,
+                     uint32_t num_wanted);
+    void refill(PPoolMagazine *mag, PRegion *rgn);
+
+    static void flushRange(void *addr, size_t sz);
+};
+
+inline uint8_t *PPool::get_state(void *ptr) const
+{
+    PPoolSlab *slab = get_slab(ptr);
+    size_t offset = static_cast<char*>(ptr) -
+        reinterpret_cast<char*>(slab) - ObjOffset_;
+    assert(slab->Pool_ == this && !(offset % Stride_) &&
+           offset / Stride_ < NumObjs_ &&
+           "Pointer is not an object of this pool!");
+    return slab->get_states() + offset / Stride_;
+}
+
+} // namespace Atlas
+
+#endif
@@ -21,27 +21,37 @@
 
 #include <cassert>
 #include <cstring>
+#include <vector>
+#include <utility>
 
 #include "atlas_api.h"
 #include "internal_api.h"
 
 #include "pmalloc.hpp"
 #include "pmalloc_util.hpp"
+#include "pextent.hpp"
+#include "ppool.hpp"
 
 namespace Atlas {
 
 class PRegion {
 public:
-    explicit PRegion(const char *nm, region_id_t rid, void *ba) 
-        : Id_{rid}, BaseAddr_{ba}, IsMapped_{true}, IsDeleted_{false},
-        FileDesc_{-1} {
+    explicit PRegion(const char *nm, region_id_t rid, void *ba,
+                     uint64_t size) 
+        : Id_{rid}, BaseAddr_{ba}, Size_{size},
+        NumArenas_{computeNumArenas(size)},
+        ArenaSize_{(size / 2 / NumArenas_) & ~(kPageSize_ - 1)},
+        IsMapped_{true}, IsDeleted_{false}, FileDesc_{-1},
+        ArenaEpoch_{PMallocUtil::get_next_arena_epoch()} {
             assert(strlen(nm) < kMaxlen_+1);
             std::strcpy(Name_, nm);
             initArenaAllocAddresses();
             PMallocUtil::set_default_tl_curr_arena(rid);
             flushDirtyCacheLines();
         }
-    ~PRegion() = default;
+    ~PRegion()
+        { for (uint32_t i = 0; i < NumArenas_; ++i)
+                Arena_[i].destroyTransients(ArenaEpoch_); }
     PRegion(const PRegion&) = delete;
     PRegion(PRegion&&) = delete;
     PRegion& operator=(const PRegion&) = delete;
@@ -50,9 +60,13 @@ public:
     void set_is_mapped(bool im) { IsMapped_ = im; NVM_FLUSH(&IsMapped_); }
     void set_is_deleted(bool id) { IsDeleted_ = id; NVM_FLUSH(&IsDeleted_); }
     void set_file_desc(int fd) { FileDesc_ = fd; }
+    // A retired entry can no longer be found by name
+    void retire() { Name_[0] = '\0'; NVM_FLUSH(&Name_[0]); }
 
     region_id_t get_id() const { return Id_; }
     void *get_base_addr() const { return BaseAddr_; }
+    uint64_t get_size() const { return Size_; }
+    uint32_t get_num_arenas() const { return NumArenas_; }
     bool is_mapped() const { return IsMapped_; }
     bool is_deleted() const { return IsDeleted_; }
     int get_file_desc() const { return FileDesc_; }
@@ -61,17 +75,29 @@ public:
     bool doesRangeCheck(const void *ptr, size_t sz) const
         { return ptr >= BaseAddr_ &&
                 (static_cast<const char*>(ptr) + sz) <
-                (static_cast<char*>(BaseAddr_) + kPRegionSize_); }
+                (static_cast<char*>(BaseAddr_) + Size_); }
     
+    // Arena transients are set up on first use
     PArena *getArena(uint32_t index)
-        { assert(index < kNumArenas_); return &Arena_[index]; }
+        { assert(index < NumArenas_);
+            Arena_[index].ensureTransients(ArenaEpoch_);
+            return &Arena_[index]; }
+    PExtentArena *getExtentArena() { return &ExtentArena_; }
+
+    bool isExtent(const void *ptr) const
+        { return ExtentArena_.doesRangeCheck(ptr); }
+    size_t getAllocSize(void *ptr);
             
     void *allocMem(
         size_t sz, bool does_need_cache_line_alignment, 
-        bool does_need_logging);
+        bool does_need_logging, bool *is_zeroed = nullptr);
     void *callocMem(size_t nmemb, size_t sz);
     void *reallocMem(void*, size_t);
     void  freeMem(void *ptr, bool should_log);
+    void allocMemBatch(
+        const size_t *sizes, size_t n, void **out, bool does_need_logging);
+    void freeMemBatch(void *const *ptrs, size_t n, bool is_logged);
+    PPool *createPool(size_t obj_size, size_t align);
 
     void setRoot(void *new_root)
         {     
@@ -99,52 +125,153 @@ public:
     void *allocRoot()
         {
             // Must be at a known offset, so bypass regular allocation
-            assert(kNumArenas_);
+            assert(NumArenas_);
             return Arena_[0].allocRawMem(sizeof(intptr_t));
         }
 
+    // Whatever arena transients the table holds belong to an earlier
+    // mapping, start a new epoch so that they are set up again
     void  initArenaTransients()
-        {
-            for (uint32_t i = 0; i < kNumArenas_; ++i)
-                getArena(i)->initTransients();
-        }
+        { ArenaEpoch_ = PMallocUtil::get_next_arena_epoch(); }
+
+    // The region must be mapped
+    void initExtentTransients()
+        { ExtentArena_.initTransients(FileDesc_); }
+
+    // Set up the transients again after the persistent metadata was
+    // changed behind the allocators' back, e.g. by recovery. Serial
+    // mode only.
+    void resetTransients()
+        { for (uint32_t i = 0; i < NumArenas_; ++i)
+                Arena_[i].destroyTransients(ArenaEpoch_);
+            initArenaTransients();
+            ExtentArena_.resetTransients(); }
+
+    void completeFree(void *is_allocated_addr)
+        { if (ExtentArena_.isDescriptor(is_allocated_addr))
+                ExtentArena_.completeFree(is_allocated_addr);
+            else if (doesRangeCheck(is_allocated_addr, 0) &&
+                     !isExtent(is_allocated_addr))
+                getArena(getArenaIndex(is_allocated_addr))->completeFree(
+                    static_cast<char*>(is_allocated_addr) - sizeof(size_t)); }
+    size_t reclaimFreeMem();
+    size_t punchHole(void *addr, size_t sz);
+
+    void bindArenasToNumaNodes();
+    void getPopulatedRanges(std::vector<std::pair<char*, size_t> > *ranges);
+    void getWrittenRanges(std::vector<std::pair<char*, size_t> > *ranges);
+    void lockAllocators();
+    void unlockAllocators();
 
     void dumpDebugInfo() const;
     void printStats();
     
 private:
-    // Region metadata follows. Except for the file descriptor, all of
-    // them are persistent and must be properly flushed out.
+    // Region metadata follows. Except for the file descriptor and the
+    // arena epoch, all of them are persistent and must be properly
+    // flushed out.
 
     // If any change to the following layout is made, the flushing
     // code may need to change as well.
     region_id_t Id_; 
     void *BaseAddr_;
+    // The lower half of the region is split into NumArenas_ arenas of
+    // ArenaSize_ bytes each, the upper half holds the extents
+    uint64_t Size_;
+    uint32_t NumArenas_;
+    uint64_t ArenaSize_;
     bool IsMapped_;
     bool IsDeleted_;
     int FileDesc_;
+    uint64_t ArenaEpoch_;
     char Name_[kMaxlen_];
-    PArena Arena_[kNumArenas_];
+    PArena Arena_[kMaxNumArenas_];
+    PExtentArena ExtentArena_;
 
+    uint32_t getArenaIndex(const void *ptr) const
+        { return (reinterpret_cast<intptr_t>(ptr) -
+                  reinterpret_cast<intptr_t>(BaseAddr_))/ArenaSize_; }
+    // Larger regions get more arenas, each at least kMinArenaSize_
+    static uint32_t computeNumArenas(uint64_t size)
+        { uint64_t n = size / 2 / kMinArenaSize_;
+            return !n ? 1 : n > kMaxNumArenas_ ? kMaxNumArenas_ : n; }
     void initArenaAllocAddresses();
+    void getArenaRanges(std::vector<std::pair<char*, size_t> > *ranges);
+    void adjustTLCurrArena();
     void *allocMemFromArenas(
         size_t sz, bool should_update_free_list,
-        bool does_need_cache_line_alignment, bool does_need_logging);
+        bool does_need_cache_line_alignment, bool does_need_logging,
+        bool *is_zeroed);
     void flushDirtyCacheLines();
 };
 
 inline void PRegion::freeMem(void *ptr, bool should_log)
 {
-    uint32_t arena_index = (reinterpret_cast<intptr_t>(ptr) -
-                            reinterpret_cast<intptr_t>(BaseAddr_))/kArenaSize_;
-    getArena(arena_index)->freeMem(ptr, should_log);
+    if (isExtent(ptr)) {
+        ExtentArena_.freeMem(ptr, should_log);
+        return;
+    }
+    uint32_t arena_index = getArenaIndex(ptr);
+    // Frees into another thread's arena do not contend for its lock
+    if (arena_index == PMallocUtil::get_tl_curr_arena(Id_))
+        getArena(arena_index)->freeMem(ptr, should_log);
+    else getArena(arena_index)->freeRemoteMem(ptr, should_log);
+}
+
+///
+/// Free chunks given in address order, locking each arena once
+///    
+inline void PRegion::freeMemBatch(void *const *ptrs, size_t n, bool is_logged)
+{
+    size_t first = 0;
+    while (first < n) {
+        uint32_t arena_index = getArenaIndex(ptrs[first]);
+        size_t last = first + 1;
+        while (last < n && getArenaIndex(ptrs[last]) == arena_index) ++last;
+        getArena(arena_index)->freeMemBatch(
+            ptrs + first, last - first, is_logged);
+        first = last;
+    }
+}
+
+inline void PRegion::adjustTLCurrArena()
+{
+#if defined(_ARENA_PER_CPU) || defined(_ARENA_NUMA)
+    // Threads migrate, so the cpu is sampled on every allocation
+    PMallocUtil::set_tl_curr_arena(Id_, PMallocUtil::get_cpu_arena(NumArenas_));
+#else    
+    if (!PMallocUtil::is_valid_tl_curr_arena(Id_))
+        PMallocUtil::set_tl_curr_arena(
+            Id_, (uint64_t)pthread_self() % NumArenas_);
+#endif
 }
 
 inline void PRegion::initArenaAllocAddresses()
 {
-    for (uint32_t i = 0; i < kNumArenas_; ++i)
-        getArena(i)->initAllocAddresses(
-            static_cast<char*>(BaseAddr_) + i * kArenaSize_);
+    for (uint32_t i = 0; i < NumArenas_; ++i)
+        Arena_[i].initAllocAddresses(
+            static_cast<char*>(BaseAddr_) + i * ArenaSize_, ArenaSize_);
+    ExtentArena_.initAllocAddresses(
+        static_cast<char*>(BaseAddr_) + Size_ / 2, Size_ - Size_ / 2);
+}
+
+///
+/// Create an object pool whose descriptor lives in this region
+///    
+inline PPool *PRegion::createPool(size_t obj_size, size_t align)
+{
+    void *mem = allocMem(sizeof(PPool), false, true);
+    assert(mem && "Out of memory in this persistent region!");
+    return new (mem) PPool(Id_, obj_size, align);
+}
+
+///
+/// Return the requested size of an allocated location
+///    
+inline size_t PRegion::getAllocSize(void *ptr)
+{
+    if (isExtent(ptr)) return ExtentArena_.getAllocSize(ptr);
+    return PMallocUtil::get_requested_alloc_size_from_ptr(ptr);
 }
 
 ///
@@ -154,6 +281,7 @@ inline void PRegion::dumpDebugInfo() const
 {
 #if defined(ATLAS_ALLOC_DUMP)    
     std::cout << Name_ << " " << Id_ << " " << BaseAddr_ << " " <<
+        Size_ << " " <<
         (IsMapped_ ? "mapped " : "unmapped ") <<
         (IsDeleted_ ? "deleted " : "valid ") << std::endl;
 #endif    
@@ -166,10 +294,24 @@ inline void PRegion::printStats()
 {
 #if defined(ATLAS_ALLOC_STATS)
     uint64_t total_alloced = 0;
-    for (uint32_t i = 0; i < kNumArenas_; ++i)
-        total_alloced += getArena(i)->get_actual_alloced();
+    uint64_t total_contention = 0;
+    for (uint32_t i = 0; i < NumArenas_; ++i) {
+        total_alloced += Arena_[i].get_actual_alloced();
+        if (Arena_[i].hasTransients(ArenaEpoch_))
+            total_contention += Arena_[i].get_contention_count();
+    }
+    total_alloced += ExtentArena_.get_actual_alloced();
     std::cout << "[Atlas] Total bytes allocated in region " <<
         Name_ << ":" << total_alloced << std::endl;
+    std::cout << "[Atlas] Bytes allocated in extents in region " <<
+        Name_ << ":" << ExtentArena_.get_actual_alloced() << std::endl;
+    std::cout << "[Atlas] Arena lock contention in region " <<
+        Name_ << ":" << total_contention << std::endl;
+    for (uint32_t i = 0; i < NumArenas_; ++i)
+        if (Arena_[i].hasTransients(ArenaEpoch_) &&
+            Arena_[i].get_contention_count())
+            std::cout << "[Atlas]   arena " << i << ": " <<
+                Arena_[i].get_contention_count() << std::endl;
 #endif
 }
         
@@ -27,19 +27,60 @@ const uint32_t kDCacheLineSize_ = 64;
 const uint32_t kMaxlen_ = kDCacheLineSize_;
     
 const uint64_t kByte_ = 1024;
+const uint64_t kPageSize_ = 4 * kByte_;
+const uint64_t kHugePageSize_ = 2 * kByte_ * kByte_;
+// Default size of a region. A region can be given any size of at
+// least kMinPRegionSize_ at creation, rounded up to a multiple of
+// kPRegionSizeAlign_ so that both of its halves (see below) are huge
+// page aligned.
 #ifdef _NVDIMM_PROLIANT
     const uint64_t kPRegionSize_ = 1 * kByte_ * kByte_ * kByte_; /* 1GB */
 #else
     const uint64_t kPRegionSize_ = 4 * kByte_ * kByte_ * kByte_; /* 4GB */
 #endif    
-const uint32_t kMaxNumPRegions_ = 100;
-const uint32_t kNumArenas_ = 64;
-const uint32_t kArenaSize_ = kPRegionSize_ / kNumArenas_;
+const uint64_t kMinPRegionSize_ = 16 * kByte_ * kByte_;
+const uint64_t kPRegionSizeAlign_ = 2 * kHugePageSize_;
+const uint32_t kMaxNumPRegions_ = 4096;
+// The lower half of a region is split into arenas, the upper half
+// holds page-granular extents for large objects. Smaller regions get
+// fewer arenas so that an arena is never below kMinArenaSize_.
+const uint32_t kMaxNumArenas_ = 64;
+const uint64_t kMinArenaSize_ = 8 * kByte_ * kByte_;
+const uint64_t kExtentThreshold_ = 256 * kByte_;
+// Object pools carve fixed-size objects out of extents of this size
+const uint64_t kPoolSlabSize_ = kExtentThreshold_;
+const uint32_t kPoolMagazineSize_ = 64;
 const uint32_t kMaxFreeCategory_ = 128;
+// Clearing at least this much bypasses the cache
+const uint64_t kNonTemporalZeroThreshold_ = 4 * kByte_;
+const uint32_t kRemoteFreeBatch_ = 64;
+// A region is prefaulted in steps of this size so that a close does
+// not wait long for the prefaulting thread
+const uint64_t kPrefaultChunkSize_ = kHugePageSize_;
+// A region snapshot waits up to kSnapshotFaseWaitMs_ for the
+// failure-atomic sections in progress to end, at most
+// kMaxSnapshotAttempts_ times. If the file system cannot clone the
+// region file, it is copied by up to kMaxSnapshotThreads_ threads in
+// pieces of kSnapshotChunkSize_ bytes. The sections are held back
+// during that copy, so it is only done for up to
+// kMaxSnapshotCopySize_ bytes of data.
+const uint32_t kSnapshotFaseWaitMs_ = 10;
+const uint32_t kMaxSnapshotAttempts_ = 100;
+const uint32_t kMaxSnapshotThreads_ = 8;
+const uint64_t kSnapshotChunkSize_ = 1 * kByte_ * kByte_;
+const uint64_t kMaxSnapshotCopySize_ = 16 * kByte_ * kByte_;
 const uint32_t kInvalidPRegion_ = kMaxNumPRegions_;
 const uint32_t kMaxBits_ = 48;
+// The region table is mapped at kPRegionsBase_ and the regions follow
+// it back to back, within a window of kPRegionsVASize_ bytes
+const uint64_t kPRegionTableSize_ = 1 * kByte_ * kByte_ * kByte_;
+const uint64_t kPRegionsVASize_ = (uint64_t)1 << 45; /* 32TB */
 const uint64_t kPRegionsBase_ = 
-    (((uint64_t)1 << (kMaxBits_ - 1)) - (kPRegionSize_ * kMaxNumPRegions_))/2;
+    (((uint64_t)1 << (kMaxBits_ - 1)) -
+     (kPRegionTableSize_ + kPRegionsVASize_))/2;
+// Identifies the layout of the region table and of the regions it
+// describes. Change it whenever either layout changes.
+const uint64_t kPRegionTableMagic_ = 0x32304e47524c5441ULL; // "ATLRGN02"
 
 } // namespace Atlas
 
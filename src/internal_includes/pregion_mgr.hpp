@@ -23,6 +23,7 @@
 #include <cassert>
 #include <utility>
 #include <atomic>
+#include <map>
 
 #include <stdint.h>
 #include <pthread.h>
@@ -34,6 +35,13 @@
 
 namespace Atlas {
 
+// Head of the persistent region table, followed by the array of
+// region descriptors
+struct PRegionTableHeader {
+    uint64_t Magic_; // kPRegionTableMagic_
+    uint32_t NumPRegions_;
+};
+
 class PRegionMgr {
     static PRegionMgr *Instance_;
 public:
@@ -43,6 +51,7 @@ public:
         Instance_ = new PRegionMgr();
         Instance_->initPRegionTable();
         Instance_->setCacheParams();
+        Instance_->setNumaParams();
         return *Instance_;
     }
 
@@ -80,16 +89,27 @@ public:
     void  freeMem(void *ptr, bool should_log = true) const;
     void  deleteMem(void *ptr, bool should_log = true) const;
     void freeMemImpl(region_id_t rgn_id, void *ptr, bool should_log) const;
+    void allocMemBatch(
+        const size_t *sizes, size_t n, region_id_t rid, void **out,
+        bool does_need_logging) const;
+    void freeMemBatch(void **ptrs, size_t n, bool should_log = true) const;
+    void completeFree(void *is_allocated_addr) const;
+    size_t reclaimFreeMem();
+    size_t punchHole(void *addr, size_t sz) const;
+    int snapshotPRegion(region_id_t rid, const char *path);
+    int restorePRegion(const char *path);
     
     void *allocMemWithoutLogging(size_t sz, region_id_t rid) const;
     void *allocMemCacheLineAligned(
         size_t sz, region_id_t rid, bool should_log) const;
             
     region_id_t findOrCreatePRegion(const char *name, int flags,
-                                    int *is_created = nullptr);
+                                    int *is_created = nullptr,
+                                    uint64_t size = kPRegionSize_);
     region_id_t findPRegion(const char *name, int flags,
                             bool is_in_recovery = false);
-    region_id_t createPRegion(const char *name, int flags);
+    region_id_t createPRegion(const char *name, int flags,
+                              uint64_t size = kPRegionSize_);
     void     closePRegion(region_id_t, bool is_deleting = false);
     void deletePRegion(const char *name);
     void deleteForcefullyPRegion(const char *name);
@@ -98,7 +118,7 @@ public:
     void *getPRegionRoot(region_id_t) const;
     void  setPRegionRoot(region_id_t, void *new_root) const;
 
-    PRegion* searchPRegion(const char *name) const;
+    PRegion* searchPRegion(const char *name);
 
     // TODO the following should take the size into consideration
     std::pair<void* /* base address */,region_id_t>
@@ -109,14 +129,36 @@ private:
     // PRegionMgr is logically transient
     void *PRegionTable_; // pointer to regions metadata
     int   PRegionTableFD_; // file holding the metadata
-    pthread_mutex_t PRegionTableLock_; // mediator across threads
+    // Mediator across threads. It is held in shared mode while
+    // finding or closing a region that exists, with the lock of that
+    // region held as well.
+    pthread_rwlock_t PRegionTableLock_;
+    pthread_mutex_t PRegionLocks_[kMaxNumPRegions_];
+    // Threads holding the table lock in shared mode share the flock
+    pthread_mutex_t SharedFLockLock_;
+    uint32_t SharedFLockCount_;
     std::atomic<PRegionExtentMap*> ExtentMap_; // region extent tracker
+    // Serializes updates of the above, regions can be mapped under
+    // the shared table lock
+    pthread_mutex_t ExtentMapLock_;
+    pthread_mutex_t NameIndexLock_;
+    PRegionNameIndex NameIndex_;
+    pthread_mutex_t PrefaultsLock_;
+    std::map<region_id_t, PRegionPrefault*> Prefaults_;
     
     enum OpType { kCreate_, kFind_, kClose_, kDelete_ };
         
     PRegionMgr() : PRegionTable_{nullptr}, PRegionTableFD_{-1},
-        ExtentMap_{new PRegionExtentMap()}
-        { pthread_mutex_init(&PRegionTableLock_, NULL); }
+        SharedFLockCount_{0}, ExtentMap_{new PRegionExtentMap()}
+        {
+            pthread_rwlock_init(&PRegionTableLock_, NULL);
+            for (uint32_t i = 0; i < kMaxNumPRegions_; ++i)
+                pthread_mutex_init(&PRegionLocks_[i], NULL);
+            pthread_mutex_init(&SharedFLockLock_, NULL);
+            pthread_mutex_init(&ExtentMapLock_, NULL);
+            pthread_mutex_init(&NameIndexLock_, NULL);
+            pthread_mutex_init(&PrefaultsLock_, NULL);
+        }
 
     ~PRegionMgr() { delete ExtentMap_.load(std::memory_order_relaxed); }
 
@@ -126,30 +168,42 @@ private:
     PRegionMgr& operator=(PRegionMgr&&) = delete;
     
     void acquireTableLock()
-        { pthread_mutex_lock(&PRegionTableLock_); }
+        { pthread_rwlock_wrlock(&PRegionTableLock_); }
+    void acquireSharedTableLock()
+        { pthread_rwlock_rdlock(&PRegionTableLock_); }
     void releaseTableLock()
-        { pthread_mutex_unlock(&PRegionTableLock_); }
+        { pthread_rwlock_unlock(&PRegionTableLock_); }
+
+    void acquirePRegionLock(region_id_t rid)
+        { pthread_mutex_lock(&PRegionLocks_[rid]); }
+    void releasePRegionLock(region_id_t rid)
+        { pthread_mutex_unlock(&PRegionLocks_[rid]); }
 
     // Mediates metadata management across processes (advisory locking)
     void acquireExclusiveFLock()
         { flock(PRegionTableFD_, LOCK_EX); }
     void releaseFLock()
         { flock(PRegionTableFD_, LOCK_UN); }
+    void acquireSharedFLock();
+    void releaseSharedFLock();
 
+    PRegionTableHeader *getPRegionTableHeader() const
+        { return static_cast<PRegionTableHeader*>(PRegionTable_); }
     uint32_t getNumPRegions() const
-        { return *(static_cast<uint32_t*>(PRegionTable_)); }
+        { return getPRegionTableHeader()->NumPRegions_; }
             
     void setNumPRegions(uint32_t);
 
-    void *computePRegionBaseAddr(void *addr) const;
-            
     PRegion *instantiateNewPRegion(region_id_t rid) const {
         return reinterpret_cast<PRegion*>(
             static_cast<char*>(PRegionTable_) +
-            sizeof(uint32_t) + rid * sizeof(PRegion));
+            sizeof(PRegionTableHeader) + rid * sizeof(PRegion));
     }
     
     void *computeNewPRegionBaseAddr() const;
+    static uint64_t computePRegionSize(uint64_t size);
+    PRegion *reuseDeletedPRegion(
+        PRegion *rgn, const char *name, int flags, uint64_t size);
 
     PRegion *getPRegionArrayPtr() const;
             
@@ -158,17 +212,37 @@ private:
 
     void setCacheParams();
     int getCacheLineSize() const;
+    void setNumaParams();
+    uint32_t getNumNumaNodes() const;
     
     void initPRegionRoot(PRegion*);
 
-    region_id_t initNewPRegionImpl(const char *name, int flags);
-    region_id_t mapNewPRegion(const char *name, int flags, void *base_addr);
+    region_id_t initNewPRegionImpl(
+        const char *name, int flags, uint64_t size);
+    region_id_t mapNewPRegion(
+        const char *name, int flags, void *base_addr, uint64_t size);
     void mapNewPRegionImpl(
         PRegion *rgn, const char *name, region_id_t rid,
-        int flags, void *base_addr);
+        int flags, void *base_addr, uint64_t size);
     void initExistingPRegionImpl(PRegion *preg, const char *name, int flags);
+    PRegion *findExistingPRegion(const char *name, int flags);
+    void openExistingPRegion(PRegion *preg, const char *name, int flags);
+    bool isPRegionMappedHere(PRegion *preg) const
+        { return getOpenPRegionId(preg->get_base_addr(), 1) ==
+                preg->get_id(); }
     void mapExistingPRegion(PRegion *preg, const char *name, int flags);
-    int mapFile(const char *name, int flags, void *base_addr, bool does_exist);
+    int mapFile(const char *name, int flags, void *base_addr, uint64_t size,
+                bool does_exist);
+
+    void startPrefault(PRegion *preg, int flags);
+    void stopPrefault(region_id_t rid);
+    static void *prefault(void *arg);
+
+    bool isSnapshotCandidate(region_id_t rid) const;
+    bool pauseForSnapshot() const;
+    int copyPRegion(PRegion *preg, int fd) const;
+    static void *copySnapshotPieces(void *arg);
+    int restorePRegionFile(int fd, const char *name, uint64_t size) const;
 
     void deleteForcefullyPRegion(PRegion*);
     
@@ -187,6 +261,13 @@ inline void *PRegionMgr::allocMem(
         sz, does_need_cache_line_alignment, does_need_logging);
 }
 
+inline void PRegionMgr::allocMemBatch(
+    const size_t *sizes, size_t n, region_id_t rid, void **out,
+    bool does_need_logging) const
+{
+    getPRegion(rid)->allocMemBatch(sizes, n, out, does_need_logging);
+}
+
 inline void *PRegionMgr::callocMem(
     size_t nmemb, size_t sz, region_id_t rid) const
 {
@@ -219,7 +300,7 @@ inline void *PRegionMgr::allocMemCacheLineAligned(
 inline PRegion *PRegionMgr::getPRegionArrayPtr() const
 {
     return reinterpret_cast<PRegion*>(
-        static_cast<char*>(PRegionTable_) + sizeof(uint32_t));
+        static_cast<char*>(PRegionTable_) + sizeof(PRegionTableHeader));
 }
 
 inline void *PRegionMgr::getPRegionRoot(region_id_t rid) const
@@ -228,32 +309,25 @@ inline void *PRegionMgr::getPRegionRoot(region_id_t rid) const
 }
 
 ///
-/// Given an address, return the base address of the corresponding
-/// persistent region
+/// Compute the base address of the next new persistent region. Regions
+/// are laid out back to back in creation order past the region table.
 ///    
-inline void *PRegionMgr::computePRegionBaseAddr(void *addr) const
+inline void *PRegionMgr::computeNewPRegionBaseAddr() const
 {
-    assert(addr >= (static_cast<char*>(PRegionTable_) + kPRegionSize_) &&
-           addr < (static_cast<char*>(PRegionTable_) +
-                   kPRegionSize_ * (kMaxNumPRegions_ + 1)) &&
-           "Location not in any persistent region!");
-    return static_cast<char*>(PRegionTable_) + kPRegionSize_ * 
-        ((reinterpret_cast<uint64_t>(addr) -
-          reinterpret_cast<uint64_t>(PRegionTable_))/kPRegionSize_);
+    uint32_t num_regions = getNumPRegions();
+    if (!num_regions) return (char*)kPRegionsBase_ + kPRegionTableSize_;
+    PRegion *last_rgn = getPRegionArrayPtr() + num_regions - 1;
+    return static_cast<char*>(last_rgn->get_base_addr()) +
+        last_rgn->get_size();
 }
 
 ///
-/// Compute the base address of the next new persistent region
+/// Round a requested region size to one that can be laid out
 ///    
-inline void *PRegionMgr::computeNewPRegionBaseAddr() const
+inline uint64_t PRegionMgr::computePRegionSize(uint64_t size)
 {
-    uint32_t num_regions = getNumPRegions();
-    if (!num_regions) return (char*)kPRegionsBase_ + kPRegionSize_;
-    else return static_cast<char*>(
-        reinterpret_cast<PRegion*>(
-            reinterpret_cast<char*>(getPRegionArrayPtr()) +
-            (num_regions - 1) * sizeof(PRegion))->
-        get_base_addr()) + kPRegionSize_;
+    if (size < kMinPRegionSize_) size = kMinPRegionSize_;
+    return (size + kPRegionSizeAlign_ - 1) & ~(kPRegionSizeAlign_ - 1);
 }
     
 ///
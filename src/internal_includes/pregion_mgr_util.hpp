@@ -20,7 +20,13 @@
 #define PREGION_MGR_UTIL_HPP
 
 #include <map>
+#include <vector>
+#include <string>
+#include <unordered_map>
 #include <utility>
+#include <atomic>
+
+#include <pthread.h>
 
 #include "pregion_configs.hpp"
 
@@ -65,6 +71,53 @@ public:
 private:
     MapInterval Extents_;
 };
+
+// Transient index from region names to ids, covering the first
+// get_num_indexed() entries of the region table. Entries are only
+// ever appended to the table, so the index can be caught up lazily.
+class PRegionNameIndex {
+public:
+    PRegionNameIndex() : NumIndexed_{0} {}
+
+    uint32_t get_num_indexed() const { return NumIndexed_; }
+
+    // A later entry with the same name replaces an earlier one, whose
+    // name must have been cleared
+    void insert(const char *name, uint32_t id)
+        { if (*name) Ids_[name] = id; ++NumIndexed_; }
+
+    uint32_t find(const char *name) const {
+        std::unordered_map<std::string,uint32_t>::const_iterator ci =
+            Ids_.find(name);
+        if (ci != Ids_.end()) return ci->second;
+        return kInvalidPRegion_;
+    }
+private:
+    std::unordered_map<std::string,uint32_t> Ids_;
+    uint32_t NumIndexed_;
+};
+
+// Transient state of the thread prefaulting the populated ranges of a
+// region in the background
+struct PRegionPrefault {
+    pthread_t Thread_;
+    std::atomic<bool> ShouldStop_;
+    bool IsWritable_;
+    std::vector<std::pair<char* /* start */, size_t /* length */> > Ranges_;
+};
+
+// Shared state of the threads copying a region into a snapshot when
+// the file system cannot clone the region file
+struct PRegionSnapshotCopy {
+    int SrcFD_;
+    int DstFD_;
+    char *BaseAddr_; // at file offset 0
+    std::vector<std::pair<char* /* start */, size_t /* length */> > Pieces_;
+    std::atomic<size_t> NextPiece_;
+    // Cleared once the kernel refuses to copy between the two files
+    std::atomic<bool> IsInKernel_;
+    std::atomic<int> Errno_;
+};
     
 } // namespace Atlas
             
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#ifndef RECOVERY_HPP
+#define RECOVERY_HPP
+
+#include <cassert>
+#include <atomic>
+#include <vector>
+#include <utility>
+
+#include <pthread.h>
+
+#include "log_mgr.hpp"
+#include "util.hpp"
+
+namespace Atlas {
+
+// Maps a log entry to its position in the flat array of log entries,
+// using open addressing with linear probing. Log entries are never
+// removed during recovery.
+class LogEntryIndex {
+public:
+    void init(size_t num_entries);
+    void insert(LogEntry *le, uint32_t pos);
+    bool find(LogEntry *le, uint32_t *pos) const;
+private:
+    std::vector<LogEntry*> Keys_;
+    std::vector<uint32_t> Positions_;
+    uint32_t Shift_;
+    uint64_t getSlot(LogEntry *le) const
+        { return (reinterpret_cast<uint64_t>(le) / sizeof(LogEntry) *
+                  0x9e3779b97f4a7c15ULL) >> Shift_; }
+};
+
+// A run of consecutive log entries of a thread, undone as a unit from
+// the last one in program order down to the first one. The log of a
+// thread is cut right above a release and right below an acquire
+// that are related by happens-before, so such relations become edges
+// between runs. The runs are undone in reverse happens-before order,
+// those not ordered with each other in parallel.
+struct RecoveryNode {
+    int Tid;
+    uint32_t Lo; // position of the first log entry
+    uint32_t Hi; // position past the last log entry
+    uint32_t NumPreds; // runs to be undone before this one
+};
+
+// Upper bound on the number of threads undoing runs
+const uint32_t kMaxRecoveryThreads = 16;
+// Fewest pages worth a thread of their own when populating them
+const size_t kPrefaultMinPages = 64;
+
+// Brings the persistent regions named in the log of a crashed process
+// back to a consistent state. Used by the recover tool and, at
+// NVM_Initialize, by the process itself. The log manager instance
+// must refer to the log region. The undone data is persistent once
+// run() returns, so the log can then be deleted. Progress is reported
+// on stderr only if asked for, as the recover tool does. Currently,
+// there is at most one instance of this class.
+class Recovery {
+    static Recovery *Instance_;
+public:
+
+    // serial mode only
+    static Recovery& createInstance(region_id_t log_rid,
+                                    bool does_report = false) {
+        assert(!Instance_);
+        Instance_ = new Recovery(log_rid, does_report);
+        return *Instance_;
+    }
+
+    // serial mode only
+    static void deleteInstance() {
+        assert(Instance_);
+        delete Instance_;
+        Instance_ = nullptr;
+    }
+
+    static Recovery& getInstance() {
+        assert(Instance_);
+        return *Instance_;
+    }
+
+    // Regions mapped by the recovery, including the log region
+    const MapInterval& get_mapped_prs() const { return MappedPRs_; }
+
+    // Returns false if there is no log to undo
+    bool run();
+
+    static uint64_t getTimeNs();
+    // Report the time since *start_ns and restart the clock
+    static void reportPhase(const char *phase, uint64_t *start_ns);
+
+private:
+    // Log entries of all threads, each thread's in program order, one
+    // thread after the other. The entries of thread t are at positions
+    // ThreadOffsets_[t] up to ThreadOffsets_[t+1].
+    std::vector<LogEntry*> LogEntries_;
+    std::vector<uint32_t> ThreadOffsets_;
+    LogEntryIndex LogIndex_;
+    // Positions of the log entries pointing to a happens-before source
+    std::vector<uint32_t> AcquirePositions_;
+
+    // Runs in position order, their successors in compressed sparse
+    // row form: those of run n are at Succs_[SuccOffsets_[n]] up to
+    // Succs_[SuccOffsets_[n+1]]
+    std::vector<RecoveryNode> Nodes_;
+    std::vector<uint32_t> SuccOffsets_;
+    std::vector<uint32_t> Succs_;
+
+    // Runs whose predecessors are all undone, protected by ReadyLock_
+    std::vector<uint32_t> ReadyNodes_;
+    uint32_t NumDoneNodes_;
+    uint32_t NumBusyWorkers_;
+    pthread_mutex_t ReadyLock_;
+    pthread_cond_t ReadyCondition_;
+
+    // All open persistent regions must have an entry in the following
+    // data structure that maps a region address range to its region id
+    MapInterval MappedPRs_;
+
+    std::atomic<uint64_t> ReplayedCount_;
+
+    // Whether phase timings and undo counts go to stderr
+    bool DoesReport_;
+
+    Recovery(region_id_t log_rid, bool does_report);
+    ~Recovery();
+
+    LogStructure *getLogStructureHeader() const;
+    void scanLogs(LogStructure *lsp);
+    void buildGraph();
+    void mapRegions();
+    void undo();
+    static void *worker(void *dirty_lines);
+    void replayNode(const RecoveryNode & node,
+                    std::vector<uint64_t> *dirty_lines);
+    void replay(LogEntry *le, std::vector<uint64_t> *dirty_lines);
+    static void collectCacheLines(std::vector<uint64_t> *dirty_lines,
+                                  void *addr, size_t sz);
+    static void flushCacheLines(std::vector<uint64_t> *dirty_lines);
+    std::pair<uint64_t, uint64_t> ensureMapped(void *addr);
+    static void collectPages(std::vector<uint64_t> *pages,
+                             void *addr, size_t sz);
+    static void *prefaultPages(void *slice);
+    static uint32_t getNumWorkers(size_t num_tasks);
+    int getThreadOfPosition(uint32_t pos) const;
+
+    // Is the log entry one whose effect is undone?
+    static bool isReplayed(LogEntry *le)
+        { return le->isStr() || le->isMemop() || le->isStrop() ||
+                le->isAllocation() || le->isDeallocation(); }
+};
+
+} // namespace Atlas
+
+#endif
@@ -21,10 +21,13 @@
 
 #include <cstdlib>
 #include <cassert>
+#include <atomic>
 
 #include <stdint.h>
 #include <pthread.h>
 
+#include "pregion_configs.hpp"
+
 namespace Atlas {
 
 class Stats {
@@ -103,6 +106,106 @@ private:
     thread_local static uint64_t TL_NumLogFlushes;
 };
 
+// Counters kept in all builds, see NVM_GetStats
+enum StatsCounter {
+    kLoggedStoreCount, kUnloggedStoreCount, kFlushCount, kFaseCount,
+    kLogEntryCount, kLogMemUse, kHelperRoundCount, kPrunedLogEntryCount,
+    kAllocCount, kAllocBytes, kFreeCount, kPrunedFaseCount,
+    kArenaLockWaitCount,
+    kNumStatsCounters
+};
+
+// Histograms kept in all builds, see NVM_GetStats. Durations are in
+// time stamp counter cycles.
+enum StatsHistogram {
+    kFaseCyclesHistogram, kFaseFlushesHistogram,
+    kEndFaseFlushCyclesHistogram,
+    kNumStatsHistograms
+};
+
+// Log-linear buckets as in HDR histograms: a value below
+// kHistogramSubBuckets has a bucket of its own, a larger one shares a
+// bucket with the values within 1/kHistogramSubBuckets of it
+const uint32_t kHistogramSubBucketBits = 4;
+const uint32_t kHistogramSubBuckets = 1 << kHistogramSubBucketBits;
+const uint32_t kHistogramBuckets =
+    (64 - kHistogramSubBucketBits + 1) * kHistogramSubBuckets;
+
+inline uint32_t getHistogramBucket(uint64_t value)
+{
+    if (value < kHistogramSubBuckets) return value;
+    uint32_t shift = 63 - __builtin_clzll(value) - kHistogramSubBucketBits;
+    return (shift + 1) * kHistogramSubBuckets +
+        ((value >> shift) & (kHistogramSubBuckets - 1));
+}
+
+// Largest value falling in a bucket
+inline uint64_t getHistogramBucketMax(uint32_t bucket)
+{
+    if (bucket < kHistogramSubBuckets) return bucket;
+    uint32_t shift = bucket / kHistogramSubBuckets - 1;
+    return ((uint64_t)(kHistogramSubBuckets + bucket % kHistogramSubBuckets)
+            << shift) + ((1ULL << shift) - 1);
+}
+
+// Every thread counts in a slot of its own, registered the first time
+// it counts anything, and a snapshot sums the slots without taking a
+// lock. A slot is only written by its owner, so there is no atomic
+// read-modify-write. When the thread exits, the slot is handed over to
+// the next new thread along with its counts, so nothing is lost or
+// counted twice. Slots are never freed.
+class StatsRegistry {
+public:
+    static void increment(StatsCounter counter, uint64_t n = 1) {
+        StatsSlot *slot = TL_Slot_ ? TL_Slot_ : acquireSlot();
+        slot->Counters_[counter].store(
+            slot->Counters_[counter].load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed);
+    }
+
+    // nvm_clflush counts in num_flushes, which only its thread can
+    // read. Called at the end of a failure-atomic section, a
+    // persistent sync and a round of the helper thread.
+    static void publishFlushes();
+
+    static void record(StatsHistogram histogram, uint64_t value) {
+        StatsSlot *slot = TL_Slot_ ? TL_Slot_ : acquireSlot();
+        std::atomic<uint64_t> & bucket =
+            slot->Buckets_[histogram][getHistogramBucket(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    }
+
+    static void getSnapshot(uint64_t counters[kNumStatsCounters]);
+    static void getHistogramSnapshot(StatsHistogram histogram,
+                                     uint64_t buckets[kHistogramBuckets]);
+    // Smallest bucket bound at or above a fraction of the values
+    static uint64_t getPercentile(const uint64_t buckets[kHistogramBuckets],
+                                  double fraction);
+    static void printHistograms();
+
+private:
+    struct StatsSlot {
+        std::atomic<uint64_t> Counters_[kNumStatsCounters];
+        std::atomic<uint64_t> Buckets_[kNumStatsHistograms][kHistogramBuckets];
+        std::atomic<bool> IsInUse_;
+        StatsSlot *Next_;
+    };
+
+    // Slots are pushed at the head and never removed
+    static std::atomic<StatsSlot*> Slots_;
+    static pthread_key_t SlotKey_;
+    static pthread_once_t SlotKeyOnce_;
+
+    thread_local static StatsSlot *TL_Slot_;
+    // Part of num_flushes counted in the slot so far
+    thread_local static uint64_t TL_PublishedFlushes_;
+
+    static StatsSlot *acquireSlot();
+    static void releaseSlot(void *slot);
+    static void createSlotKey();
+};
+
 } // namespace Atlas
     
 #endif
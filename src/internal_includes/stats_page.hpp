@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#ifndef STATS_PAGE_HPP
+#define STATS_PAGE_HPP
+
+#include <atomic>
+#include <cstring>
+
+#include <stdint.h>
+
+#include "stats.hpp"
+
+namespace Atlas {
+
+const uint64_t kStatsPageMagic = 0x5354415453544c41ULL; // "ATLSTATS"
+
+// What a running process publishes about itself
+struct StatsSample {
+    uint64_t Pid;
+    uint64_t TimeNs; // CLOCK_MONOTONIC
+    uint64_t Counters[kNumStatsCounters];
+    uint64_t HelperLagNs; // age of the oldest FASE not pruned yet
+};
+
+// Layout of the file a running process maps next to its region table,
+// see LogMgr::statsPublisher and atlas_top. A seqlock lets readers in
+// other processes copy a sample without ever blocking the writer:
+// Seq_ is odd while the sample is being updated.
+struct StatsPage {
+    uint64_t Magic_;
+    std::atomic<uint64_t> Seq_;
+    StatsSample Sample_;
+
+    void write(const StatsSample & sample) {
+        uint64_t seq = Seq_.load(std::memory_order_relaxed);
+        Seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&Sample_, &sample, sizeof(StatsSample));
+        Seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // Fails if the writer keeps updating, or died while doing so
+    bool read(StatsSample *sample) const {
+        for (uint32_t i = 0; i < kStatsPageReadTries; ++i) {
+            uint64_t seq = Seq_.load(std::memory_order_acquire);
+            if (seq & 1) continue;
+            memcpy(sample, &Sample_, sizeof(StatsSample));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Seq_.load(std::memory_order_relaxed) == seq) return true;
+        }
+        return false;
+    }
+
+    static const uint32_t kStatsPageReadTries = 1000;
+};
+
+} // namespace Atlas
+
+#endif
@@ -131,6 +131,10 @@ char *NVM_GetFullyQualifiedRegionName(const char *name);
 char *NVM_GetLogRegionName(); 
 char *NVM_GetLogRegionName(const char *prog_name);
 bool NVM_doesLogExist(const char *log_path_name);
+
+// The stats page of the running process, next to the region table
+char *NVM_GetStatsPagePath();
+char *NVM_GetStatsPagePath(const char *prog_name);
 void NVM_qualifyPathName(char *s, const char *name);
 
 #endif
@@ -61,12 +61,17 @@ CbLog<T> *LogMgr::getNewCb(uint32_t size, uint32_t rid, CbLog<T> **log_p,
     
     // Search through the list of cbl_nodes looking for one that is
     // available and is owned by this thread. If found, set isAvailable
-    // to false, isfilled to false, and return it.
+    // to in use, isfilled to false, and return it. A buffer whose pages
+    // are being returned to the OS is skipped.
     CbListNode<T> *curr_search = (*cb_list_p).load(std::memory_order_acquire);
     while (curr_search)
     {
-        if (curr_search->isAvailable.load(std::memory_order_acquire) &&
-            pthread_equal(curr_search->Tid, pthread_self()))
+        uint32_t state = curr_search->isAvailable.load(
+            std::memory_order_acquire);
+        if ((state == kCbAvailable || state == kCbReclaimed) &&
+            pthread_equal(curr_search->Tid, pthread_self()) &&
+            curr_search->isAvailable.compare_exchange_strong(
+                state, kCbInUse, std::memory_order_acq_rel))
         {
             assert(curr_search->Cb);
             assert(curr_search->Cb->isFilled.load(std::memory_order_acquire));
@@ -75,9 +80,7 @@ CbLog<T> *LogMgr::getNewCb(uint32_t size, uint32_t rid, CbLog<T> **log_p,
             
             curr_search->Cb->isFilled.store(false, std::memory_order_relaxed);
             curr_search->Cb->Start.store(0, std::memory_order_relaxed);
-            curr_search->Cb->End.store(0, std::memory_order_relaxed);
-
-            curr_search->isAvailable.store(false, std::memory_order_release);
+            curr_search->Cb->End.store(0, std::memory_order_release);
 
             return curr_search->Cb;
         }
@@ -94,6 +97,7 @@ CbLog<T> *LogMgr::getNewCb(uint32_t size, uint32_t rid, CbLog<T> **log_p,
 #ifdef NVM_STATS
     Stats_->incrementLogMemUse(cb->Size*sizeof(T));
 #endif
+    StatsRegistry::increment(kLogMemUse, cb->Size*sizeof(T));
     
     *log_p = cb;
     
@@ -126,6 +130,7 @@ inline T *LogMgr::getNewSlot(uint32_t rid, CbLog<T> **log_p,
         getNewCb<T>(kCircularBufferSize, rid, log_p, cb_list_p);
 
     ++ TL_LogCounter_;
+    StatsRegistry::increment(kLogEntryCount);
     if (TL_LogCounter_ % kCircularBufferSize == 0) ++TL_GenNum_;
     
     T *r = &((*log_p)->LogArray[(*log_p)->End.load(
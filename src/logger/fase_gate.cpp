@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <cassert>
+#include <cerrno>
+
+#include <time.h>
+
+#include "log_mgr.hpp"
+
+namespace Atlas {
+
+///
+/// @brief Called by a thread about to start a failure-atomic
+/// section. While failure-atomic sections are paused, the thread
+/// waits before publishing anything for the section.
+///    
+void LogMgr::enterFase()
+{
+#if defined(_REGION_SNAPSHOT)
+    for (;;) {
+        NumActiveFases_.fetch_add(1, std::memory_order_seq_cst);
+        if (!AreFasesPaused_.load(std::memory_order_seq_cst)) return;
+        // Step back so that the pausing thread does not wait for us
+        exitFase();
+        pthread_mutex_lock(&FaseGateLock_);
+        while (AreFasesPaused_.load(std::memory_order_acquire))
+            pthread_cond_wait(&FaseGateCondition_, &FaseGateLock_);
+        pthread_mutex_unlock(&FaseGateLock_);
+    }
+#endif
+}
+
+///
+/// @brief Called by a thread once its failure-atomic section ended
+///    
+void LogMgr::exitFase()
+{
+#if defined(_REGION_SNAPSHOT)
+    if (NumActiveFases_.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+        AreFasesPaused_.load(std::memory_order_seq_cst)) {
+        pthread_mutex_lock(&FaseGateLock_);
+        pthread_cond_broadcast(&FaseGateCondition_);
+        pthread_mutex_unlock(&FaseGateLock_);
+    }
+#endif
+}
+
+///
+/// @brief Hold back the failure-atomic sections about to start and
+/// wait for the ones in progress to end. Persistent memory then
+/// reflects completed sections only, until resumeFases is called.
+/// A section in progress may be waiting for a lock that a held back
+/// thread acquired, so the wait is given up after timeout_ms.
+/// @return Whether the sections were paused, they were resumed if not
+///
+/// Only one thread may pause the sections at a time.
+///    
+bool LogMgr::pauseFases(uint32_t timeout_ms)
+{
+#if defined(_REGION_SNAPSHOT)
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&FaseGateLock_);
+    assert(!AreFasesPaused_.load(std::memory_order_relaxed));
+    AreFasesPaused_.store(true, std::memory_order_seq_cst);
+    int status = 0;
+    while (NumActiveFases_.load(std::memory_order_seq_cst) &&
+           status != ETIMEDOUT)
+        status = pthread_cond_timedwait(&FaseGateCondition_,
+                                        &FaseGateLock_, &deadline);
+    bool is_paused = !NumActiveFases_.load(std::memory_order_seq_cst);
+    pthread_mutex_unlock(&FaseGateLock_);
+
+    if (!is_paused) resumeFases();
+    return is_paused;
+#else
+    assert(0 && "Sections can be paused with _REGION_SNAPSHOT only!");
+    return false;
+#endif
+}
+
+///
+/// @brief Let the failure-atomic sections held back proceed
+///    
+void LogMgr::resumeFases()
+{
+    pthread_mutex_lock(&FaseGateLock_);
+    AreFasesPaused_.store(false, std::memory_order_release);
+    pthread_cond_broadcast(&FaseGateCondition_);
+    pthread_mutex_unlock(&FaseGateLock_);
+}
+
+} // namespace Atlas
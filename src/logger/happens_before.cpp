@@ -39,8 +39,8 @@ LastReleaseInfo *LogMgr::findLastReleaseOfLock(void *hash_address)
         }
         LogEntry *le = ii->LogAddr;
         assert(le);
-        assert(le->isRelease() || le->isRWLockUnlock() || le->isFree());
-        if ((le->isFree() && !hash_address) || le->Addr == hash_address)
+        assert(le->isRelease() || le->isRWLockUnlock() || le->isDeallocation());
+        if ((le->isDeallocation() && !hash_address) || le->Addr == hash_address)
             return oip;
         oip = oip->Next;
     }
@@ -52,7 +52,10 @@ LastReleaseInfo *LogMgr::findLastReleaseOfLogEntry(LogEntry *candidate_le)
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    LastReleaseInfo *oip = getLastReleaseHeader(candidate_le->Addr);
+    // Frees are tracked under a single key, see addLogToLastReleaseInfo
+    bool is_dealloc = candidate_le->isDeallocation();
+    LastReleaseInfo *oip = getLastReleaseHeader(
+        is_dealloc ? NULL : candidate_le->Addr);
     while (oip) {
         ImmutableInfo *ii = oip->Immutable.load(std::memory_order_acquire);
         assert(ii);
@@ -62,9 +65,9 @@ LastReleaseInfo *LogMgr::findLastReleaseOfLogEntry(LogEntry *candidate_le)
         }
         LogEntry *le = ii->LogAddr;
         assert(le);
-        // TODO free not handled?
-        assert(le->isRelease() || le->isRWLockUnlock() || le->isFree());
-        if (le->Addr != candidate_le->Addr) {
+        assert(le->isRelease() || le->isRWLockUnlock() || le->isDeallocation());
+        if (is_dealloc ? !le->isDeallocation() :
+            le->isDeallocation() || le->Addr != candidate_le->Addr) {
             oip = oip->Next;
             continue;
         }
@@ -80,9 +83,9 @@ void LogMgr::addLogToLastReleaseInfo(LogEntry *le,
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    assert(le->isRelease() || le->isRWLockUnlock() || le->isFree());
+    assert(le->isRelease() || le->isRWLockUnlock() || le->isDeallocation());
 
-    void *hash_addr = le->isFree() ? NULL : le->Addr;
+    void *hash_addr = le->isDeallocation() ? NULL : le->Addr;
     bool done = false;
     while (!done) {
         LastReleaseInfo *oi = findLastReleaseOfLock(hash_addr);
@@ -136,7 +139,7 @@ void LogMgr::deleteOwnerInfo(LogEntry *le)
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    assert(le->isRelease() || le->isRWLockUnlock() || le->isFree());
+    assert(le->isRelease() || le->isRWLockUnlock() || le->isDeallocation());
 
     // An owner info may not be found since the one that existed before
     // for this log entry may have been overwritten by one of the user
@@ -185,7 +188,7 @@ void LogMgr::setHappensBeforeForAllocFree(LogEntry *le)
         ImmutableInfo *ii = oi->Immutable.load(std::memory_order_acquire);
         le->ValueOrPtr = reinterpret_cast<intptr_t>(ii->LogAddr);
 
-        assert(reinterpret_cast<LogEntry*>(le->ValueOrPtr)->isFree());
+        assert(reinterpret_cast<LogEntry*>(le->ValueOrPtr)->isDeallocation());
         le->Size = reinterpret_cast<LogEntry*>(le->ValueOrPtr)->Size;
     }
 }
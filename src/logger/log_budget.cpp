@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <cassert>
+#include <cerrno>
+
+#include <time.h>
+
+#include "log_mgr.hpp"
+
+namespace Atlas {
+
+///
+/// @brief Add the log entries created by this thread since it last
+/// did to the total
+///    
+void LogMgr::publishLogCount()
+{
+#if defined(_BOUNDED_RECOVERY)
+    NumLoggedEntries_.fetch_add(TL_LogCounter_ - TL_PublishedLogCounter_,
+                                std::memory_order_relaxed);
+    TL_PublishedLogCounter_ = TL_LogCounter_;
+#endif
+}
+
+bool LogMgr::isOverLogBudget(uint64_t budget_bytes) const
+{
+    // Counts not published yet may make the pruned ones look larger
+    int64_t num_outstanding =
+        NumLoggedEntries_.load(std::memory_order_relaxed) -
+        NumPrunedEntries_.load(std::memory_order_acquire);
+    return num_outstanding > 0 &&
+        (uint64_t)num_outstanding * sizeof(LogEntry) > budget_bytes;
+}
+
+///
+/// @brief Called by a thread at the end of a failure-atomic
+/// section. If the log is over budget, the helper thread is woken up
+/// and the thread waits until the log is down to half the budget, so
+/// that the helper thread gets to prune in large rounds. The helper
+/// thread cannot prune what a section in progress depends on, so the
+/// wait ends as well once a round prunes nothing, or after
+/// kLogBudgetWaitMs.
+///    
+void LogMgr::waitForLogBudget()
+{
+#if defined(_BOUNDED_RECOVERY)
+    if (!isOverLogBudget(kMaxOutstandingLogBytes)) return;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += kLogBudgetWaitMs / 1000;
+    deadline.tv_nsec += (kLogBudgetWaitMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&LogBudgetLock_);
+    uint64_t round_num = HelperRoundNum_;
+    signalLogReady();
+    int status = 0;
+    while (isOverLogBudget(kMaxOutstandingLogBytes / 2) &&
+           !(HelperRoundNum_ != round_num && !LastRoundPruned_) &&
+           status != ETIMEDOUT)
+        status = pthread_cond_timedwait(&LogBudgetCondition_,
+                                        &LogBudgetLock_, &deadline);
+    pthread_mutex_unlock(&LogBudgetLock_);
+#endif
+}
+
+///
+/// @brief Called by the helper thread at the end of every round with
+/// the number of log entries it pruned
+///    
+void LogMgr::notePrunedLogEntries(uint64_t num_pruned)
+{
+#if defined(_BOUNDED_RECOVERY)
+    NumPrunedEntries_.fetch_add(num_pruned, std::memory_order_release);
+    pthread_mutex_lock(&LogBudgetLock_);
+    ++HelperRoundNum_;
+    LastRoundPruned_ = num_pruned;
+    pthread_cond_broadcast(&LogBudgetCondition_);
+    pthread_mutex_unlock(&LogBudgetLock_);
+#endif
+}
+
+} // namespace Atlas
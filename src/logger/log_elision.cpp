@@ -132,6 +132,7 @@ bool LogMgr::doesNeedLogging(void *addr, size_t sz)
 #ifdef NVM_STATS
             Stats_->incrementUnloggedCriticalSectionStoreCount();
 #endif            
+            StatsRegistry::increment(kUnloggedStoreCount);
             return false;
         }
 #endif        
@@ -187,6 +188,7 @@ bool LogMgr::tryLogElision(void *addr, size_t sz)
 #ifdef NVM_STATS
         Stats_->incrementUnloggedStoreCount();
 #endif
+        StatsRegistry::increment(kUnloggedStoreCount);
         return true;
     }
 #ifdef NVM_STATS    
@@ -52,6 +52,7 @@ void LogMgr::logNonTemporal(
         memcpy((void*)le_nt.ValueOrPtr, addr, sz);
     }
     else assert(isDummy(le_type) || isAlloc(le_type) || isFree(le_type) ||
+                isPoolAlloc(le_type) || isPoolFree(le_type) ||
                 isStartSection(le_type) || isEndSection(le_type));
     
     long long unsigned int *from =
@@ -105,7 +106,8 @@ LogEntry *LogMgr::createSectionLogEntry(void *lock_address, LogType le_type)
 
 ///
 /// @brief Create log entry for allocation/deallocation. The address
-/// corresponds to that of the isAllocated bit
+/// corresponds to that of the isAllocated bit, or the state byte of
+/// a pool object
 /// @param addr Address of memory location to be logged
 /// @param le_type Type of access to be logged
 /// @retval Pointer to created log entry
@@ -115,7 +117,8 @@ LogEntry *LogMgr::createAllocationLogEntry(void *addr, LogType le_type)
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    assert(le_type == LE_alloc || le_type == LE_free);
+    assert(le_type == LE_alloc || le_type == LE_free ||
+           le_type == LE_pool_alloc || le_type == LE_pool_free);
 
     LogEntry *le = allocLogEntry();
     assert(le);
@@ -127,11 +130,72 @@ LogEntry *LogMgr::createAllocationLogEntry(void *addr, LogType le_type)
     uintptr_t le_val_or_ptr = 0 /* initial value */;
     LogEntry *le_next = nullptr; /* initial value */
     new (le) LogEntry(addr, le_val_or_ptr, le_next,
-                      isFree(le_type) ? TL_GenNum_ : sizeof(size_t),
+                      isFree(le_type) || isPoolFree(le_type) ?
+                      TL_GenNum_ : sizeof(size_t),
                       le_type);
     return le;
 }
 
+///
+/// @brief Create log entry for a contiguous run of allocations
+/// @param addr Address of the first chunk header of the run
+/// @param sz Size of the run in bytes
+/// @retval Pointer to created log entry
+///
+/// Undo walks the chunk headers in the run, so the size is kept
+/// and no happens-before pointer is recorded.
+///    
+LogEntry *LogMgr::createAllocBatchLogEntry(void *addr, size_t sz)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    LogEntry *le = allocLogEntry();
+    assert(le);
+
+    uintptr_t le_val_or_ptr = 0 /* ignored */;
+    LogEntry *le_next = nullptr; /* initial value */
+    new (le) LogEntry(addr, le_val_or_ptr, le_next, sz, LE_alloc_batch);
+    return le;
+}
+
+///
+/// @brief Create log entry for a group of deallocations
+/// @param addrs Addresses of the isAllocated bits
+/// @param n Number of addresses
+/// @retval Pointer to created log entry
+///
+/// Addr points to a buffer holding the count followed by the
+/// addresses. As for a single free, ValueOrPtr is reserved for the
+/// happens-before log entry.
+///    
+LogEntry *LogMgr::createFreeBatchLogEntry(void **addrs, size_t n)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    LogEntry *le = allocLogEntry();
+    assert(le);
+
+    size_t sz = (n + 1) * sizeof(size_t);
+#if defined(_LOG_WITH_MALLOC)    
+    size_t *buf = static_cast<size_t*>(malloc(sz));
+#else
+    size_t *buf = static_cast<size_t*>(
+        PRegionMgr::getInstance().allocMemWithoutLogging(sz, RegionId_));
+#endif
+    assert(buf);
+    buf[0] = n;
+    memcpy(buf + 1, addrs, n * sizeof(void*));
+    NVM_PSYNC(buf, sz);
+    
+    uintptr_t le_val_or_ptr = 0 /* initial value */;
+    LogEntry *le_next = nullptr; /* initial value */
+    new (le) LogEntry(buf, le_val_or_ptr, le_next, TL_GenNum_,
+                      LE_free_batch);
+    return le;
+}
+
 ///
 /// @brief Create log entry for the store instruction
 /// @param addr Address of memory location stored into
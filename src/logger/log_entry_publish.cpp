@@ -19,6 +19,7 @@
 #include "log_mgr.hpp"
 #include "log_structure.hpp"
 #include "happens_before.hpp"
+#include "internal_api.h"
 
 #include "atlas_alloc.h"
 
@@ -115,6 +116,12 @@ void LogMgr::publishLogEntry(LogEntry *le)
         }
 #endif        
     }
+#if defined(_MSYNC_DURABILITY) && !defined(DISABLE_FLUSHES) && \
+    !defined(_DISABLE_LOG_FLUSH)
+    // Undo information must be durable before the update it covers:
+    // the kernel may write back the updated page at any time
+    nvm_sync_dirty_log_pages();
+#endif
 }
 
 ///
@@ -127,6 +134,11 @@ void LogMgr::finishAcquire(void *lock_address, LogEntry *le)
 {
     assert(TL_NumHeldLocks_ >= 0);
 
+    if (!TL_NumHeldLocks_) {
+        enterFase();
+        TL_FaseStartCycles_ = atlas_rdtsc();
+        TL_FaseStartFlushes_ = num_flushes;
+    }
     ++TL_NumHeldLocks_;
 
 #ifdef NVM_STATS
@@ -160,7 +172,7 @@ void LogMgr::finishAcquire(void *lock_address, LogEntry *le)
             // assignment below to work.
             LogEntry *rel_le = reinterpret_cast<LogEntry*>(le->ValueOrPtr);
             assert(rel_le->isRelease() || rel_le->isRWLockUnlock() ||
-                   rel_le->isFree());
+                   rel_le->isDeallocation());
             le->Size = rel_le->Size;
             
             MapOfLockInfo *moli = ii->LockInfoPtr;
@@ -202,7 +214,14 @@ void LogMgr::markEndFase(LogEntry *le)
     if (TL_UniqueLoc_) TL_UniqueLoc_->clear();
 #endif    
 
+    uint64_t flush_start = atlas_rdtsc();
     flushAtEndOfFase();
+    StatsRegistry::record(kEndFaseFlushCyclesHistogram,
+                          atlas_rdtsc() - flush_start);
+    StatsRegistry::record(kFaseFlushesHistogram,
+                          num_flushes - TL_FaseStartFlushes_);
+    StatsRegistry::increment(kFaseCount);
+    StatsRegistry::publishFlushes();
 
     TL_IsFirstNonCSStmt_ = true;
 
@@ -217,6 +236,13 @@ void LogMgr::markEndFase(LogEntry *le)
     LogEntry *dummy_le = createDummyLogEntry();
     publishLogEntry(dummy_le);
     TL_LastLogEntry_ = dummy_le;
+
+    exitFase();
+    waitForLogBudget();
+
+    // Waiting for the log budget is charged to the FASE that caused it
+    StatsRegistry::record(kFaseCyclesHistogram,
+                          atlas_rdtsc() - TL_FaseStartCycles_);
 }
 
 void LogMgr::finishWrite(LogEntry * le, void * addr)
@@ -227,6 +253,7 @@ void LogMgr::finishWrite(LogEntry * le, void * addr)
     Stats_->incrementLoggedStoreCount();
     if (TL_NumHeldLocks_ > 0) Stats_->incrementCriticalLoggedStoreCount();
 #endif    
+    StatsRegistry::increment(kLoggedStoreCount);
         
     publishLogEntry(le);
     TL_LastLogEntry_ = le;
@@ -19,6 +19,9 @@
 #include "log_mgr.hpp"
 #include "log_structure.hpp"
 #include "happens_before.hpp"
+#if defined(_IN_PROCESS_RECOVERY)
+#include "recovery.hpp"
+#endif
 
 #include "atlas_alloc.h"
 
@@ -33,6 +36,9 @@ thread_local MapOfLockInfo *LogMgr::TL_UndoLocks_{nullptr};
 thread_local bool LogMgr::TL_IsFirstNonCSStmt_{true};
 thread_local bool LogMgr::TL_ShouldLogNonCSStmt_{true};
 thread_local uint64_t LogMgr::TL_LogCounter_{0};
+thread_local uint64_t LogMgr::TL_PublishedLogCounter_{0};
+thread_local uint64_t LogMgr::TL_FaseStartCycles_{0};
+thread_local uint64_t LogMgr::TL_FaseStartFlushes_{0};
 #if defined(_FLUSH_LOCAL_COMMIT)  && !defined(DISABLE_FLUSHES)
     thread_local SetOfInts *LogMgr::TL_FaseFlushPtr_{new SetOfInts};
 #else
@@ -64,20 +70,24 @@ void LogMgr::init()
 #endif
     std::cout << "[Atlas] -- Started --" << std::endl;
 
+#ifdef NVM_STATS
+    Stats_ = &Stats::createInstance();
+#endif
+    
+    PRegionMgr::createInstance();
+    
     char *log_name = NVM_GetLogRegionName();
     if (NVM_doesLogExist(NVM_GetFullyQualifiedRegionName(log_name))) {
+#if defined(_IN_PROCESS_RECOVERY)
+        recoverInProcess(log_name);
+#else        
         std::cout <<
             "[Atlas] The program crashed earlier, please run recovery ..." <<
             std::endl;
         std::cout << "[Atlas] -- Finished --" << std::endl;
         exit(0);
-    }
-    
-#ifdef NVM_STATS
-    Stats_ = &Stats::createInstance();
 #endif
-    
-    PRegionMgr::createInstance();
+    }
     
     RegionId_ = NVM_CreateRegion(log_name, O_RDWR);
     
@@ -103,8 +113,52 @@ void LogMgr::init()
     int status = pthread_create(&HelperThread_, nullptr,
                                 (void *(*)(void *))helper, nullptr);
     assert(!status);
+
+#if defined(_RECLAIM_MEMORY)
+    startReclaimer();
+#endif
+    startStatsPublisher();
 }
 
+#if defined(_IN_PROCESS_RECOVERY)
+///
+/// @brief Undo the log left behind by a crash of this program, using
+/// the region manager of this process. The regions mapped on the way
+/// stay mapped for the program to find, saving a separate recovery
+/// run that would map them all over again.
+///
+void LogMgr::recoverInProcess(const char *log_name)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    std::cout <<
+        "[Atlas] The program crashed earlier, recovering ..." << std::endl;
+
+    bool is_in_recovery = true;
+    RegionId_ = PRegionMgr::getInstance().findPRegion(
+        log_name, O_RDWR, is_in_recovery);
+    assert(RegionId_ != kInvalidPRegion_ &&
+           "Log region not found in region table!");
+
+    Recovery& rec = Recovery::createInstance(RegionId_);
+    if (!rec.run())
+        std::cout << "[Atlas] Warning: No logs present" << std::endl;
+
+    // The allocator transients were set up before the undo
+    const MapInterval & mapped_prs = rec.get_mapped_prs();
+    for (MapInterval::const_iterator ci = mapped_prs.begin();
+         ci != mapped_prs.end(); ++ ci)
+        if (ci->second != RegionId_)
+            PRegionMgr::getInstance().getPRegion(
+                ci->second)->resetTransients();
+    Recovery::deleteInstance();
+
+    NVM_DeleteRegion(log_name);
+    RecoveryTimeLsp_.store(nullptr, std::memory_order_release);
+}
+#endif
+
 ///
 /// @brief Finalize the log manager, joins the helper thread and does
 /// other bookkeeping. Called by NVM_Finalize which must be called by
@@ -115,6 +169,11 @@ void LogMgr::finalize()
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
+    stopStatsPublisher();
+#if defined(_RECLAIM_MEMORY)
+    stopReclaimer();
+#endif
+    
     acquireLogReadyLock();
     AllDone_.store(1, std::memory_order_release);
     releaseLogReadyLock();
@@ -130,6 +189,7 @@ void LogMgr::finalize()
     PRegionMgr::deleteInstance();
 
 #ifdef NVM_STATS    
+    StatsRegistry::printHistograms();
     Stats_->deleteInstance();
 #endif    
 
@@ -148,6 +208,7 @@ void LogMgr::signalHelper()
 #endif
     ++TL_LogCount_;
     if (TL_LogCount_ == kWorkThreshold) {
+        publishLogCount();
         int status = pthread_cond_signal(&HelperCondition_);
         assert(!status);
         TL_LogCount_ = 0;
@@ -228,7 +289,7 @@ void LogMgr::logEndDurable()
     signalHelper();
 }
 
-void LogMgr::logAlloc(void *addr)
+void LogMgr::logAlloc(void *addr, LogType le_type)
 {
 #ifdef _FORCE_FAIL
     fail_program();
@@ -236,7 +297,7 @@ void LogMgr::logAlloc(void *addr)
     // TODO: use the arena lock for log elision
     if (tryLogElision(NULL, 0)) return;
     
-    LogEntry *le = createAllocationLogEntry(addr, LE_alloc);
+    LogEntry *le = createAllocationLogEntry(addr, le_type);
 
 #ifndef _NO_NEST    
     // An allocation is currently treated as an acquire operation
@@ -248,15 +309,15 @@ void LogMgr::logAlloc(void *addr)
     TL_LastLogEntry_ = le;
 }
 
-void LogMgr::logFree(void *addr)
+bool LogMgr::logFree(void *addr, LogType le_type)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
     // TODO: use the arena lock for log elision
-    if (tryLogElision(NULL, 0)) return;
+    if (tryLogElision(NULL, 0)) return false;
     
-    LogEntry *le = createAllocationLogEntry(addr, LE_free);
+    LogEntry *le = createAllocationLogEntry(addr, le_type);
 
 #ifndef _NO_NEST    
     // If there is a previous free, create a happens after link free -> free
@@ -272,6 +333,47 @@ void LogMgr::logFree(void *addr)
 #endif
 
     TL_LastLogEntry_ = le;
+    return true;
+}
+
+void LogMgr::logAllocBatch(void *addr, size_t sz)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    if (tryLogElision(NULL, 0)) return;
+    
+    // A batch is carved from memory that was never allocated before,
+    // so there is no free it needs to happen after
+    LogEntry *le = createAllocBatchLogEntry(addr, sz);
+
+    publishLogEntry(le);
+
+    TL_LastLogEntry_ = le;
+}
+
+bool LogMgr::logFreeBatch(void **addrs, size_t n)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    if (tryLogElision(NULL, 0)) return false;
+    
+    LogEntry *le = createFreeBatchLogEntry(addrs, n);
+
+#ifndef _NO_NEST    
+    // Ordered with other frees exactly like a single free
+    setHappensBeforeForAllocFree(le);
+#endif
+    
+    publishLogEntry(le);
+
+#ifndef _NO_NEST
+    addLogToLastReleaseInfo(le, *new MapOfLockInfo);
+#endif
+
+    TL_LastLogEntry_ = le;
+    return true;
 }
 
 } // namespace Atlas
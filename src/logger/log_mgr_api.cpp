@@ -132,10 +132,34 @@ void nvm_log_alloc(void *addr)
     Atlas::LogMgr::getInstance().logAlloc(addr);
 }
 
-void nvm_log_free(void *addr)
+int nvm_log_free(void *addr)
+{
+    if (!Atlas::LogMgr::hasInstance()) return false;
+    return Atlas::LogMgr::getInstance().logFree(addr);
+}
+
+void nvm_log_alloc_batch(void *addr, size_t sz)
+{
+    if (!Atlas::LogMgr::hasInstance()) return;
+    Atlas::LogMgr::getInstance().logAllocBatch(addr, sz);
+}
+
+int nvm_log_free_batch(void **addrs, size_t n)
+{
+    if (!Atlas::LogMgr::hasInstance()) return false;
+    return Atlas::LogMgr::getInstance().logFreeBatch(addrs, n);
+}
+
+void nvm_log_pool_alloc(void *addr)
 {
     if (!Atlas::LogMgr::hasInstance()) return;
-    Atlas::LogMgr::getInstance().logFree(addr);
+    Atlas::LogMgr::getInstance().logAlloc(addr, Atlas::LE_pool_alloc);
+}
+
+void nvm_log_pool_free(void *addr)
+{
+    if (!Atlas::LogMgr::hasInstance()) return;
+    Atlas::LogMgr::getInstance().logFree(addr, Atlas::LE_pool_free);
 }
 
 void nvm_barrier(void *p)
@@ -157,6 +181,7 @@ void nvm_psync(void *start_addr, size_t sz)
 {
     assert(Atlas::LogMgr::hasInstance());
     Atlas::LogMgr::getInstance().psync(start_addr, sz);
+    Atlas::StatsRegistry::publishFlushes();
 }
 
 // TODO: The way the LLVM NVM instrumenter is working today, this introduces
@@ -165,6 +190,7 @@ void nvm_psync_acq(void *start_addr, size_t sz)
 {
     assert(Atlas::LogMgr::hasInstance());
     Atlas::LogMgr::getInstance().psyncWithAcquireBarrier(start_addr, sz);
+    Atlas::StatsRegistry::publishFlushes();
 }
 
 #if defined(_USE_TABLE_FLUSH)
@@ -189,4 +215,52 @@ void NVM_PrintStats()
 }
 #endif
 
+static void summarizeHistogram(Atlas::StatsHistogram histogram,
+                               struct atlas_histogram_summary *summary)
+{
+    uint64_t buckets[Atlas::kHistogramBuckets];
+    Atlas::StatsRegistry::getHistogramSnapshot(histogram, buckets);
+    summary->count = 0;
+    for (uint32_t i = 0; i < Atlas::kHistogramBuckets; ++i)
+        summary->count += buckets[i];
+    summary->p50 = Atlas::StatsRegistry::getPercentile(buckets, 0.5);
+    summary->p90 = Atlas::StatsRegistry::getPercentile(buckets, 0.9);
+    summary->p99 = Atlas::StatsRegistry::getPercentile(buckets, 0.99);
+    summary->p999 = Atlas::StatsRegistry::getPercentile(buckets, 0.999);
+    summary->max = Atlas::StatsRegistry::getPercentile(buckets, 1.0);
+}
+
+void NVM_GetStats(struct atlas_stats *stats)
+{
+    assert(stats);
+    uint64_t counters[Atlas::kNumStatsCounters];
+    Atlas::StatsRegistry::getSnapshot(counters);
+    stats->logged_stores = counters[Atlas::kLoggedStoreCount];
+    stats->unlogged_stores = counters[Atlas::kUnloggedStoreCount];
+    stats->flushes = counters[Atlas::kFlushCount];
+    stats->fases = counters[Atlas::kFaseCount];
+    stats->log_bytes =
+        counters[Atlas::kLogEntryCount] * sizeof(Atlas::LogEntry);
+    stats->log_mem_bytes = counters[Atlas::kLogMemUse];
+    stats->log_reclaimed_bytes = Atlas::LogMgr::hasInstance() ?
+        Atlas::LogMgr::getInstance().get_reclaimed_bytes() : 0;
+    stats->helper_rounds = counters[Atlas::kHelperRoundCount];
+    stats->pruned_log_bytes =
+        counters[Atlas::kPrunedLogEntryCount] * sizeof(Atlas::LogEntry);
+    stats->allocs = counters[Atlas::kAllocCount];
+    stats->alloc_bytes = counters[Atlas::kAllocBytes];
+    stats->frees = counters[Atlas::kFreeCount];
+    stats->pruned_fases = counters[Atlas::kPrunedFaseCount];
+    stats->arena_lock_waits = counters[Atlas::kArenaLockWaitCount];
+    summarizeHistogram(Atlas::kFaseCyclesHistogram, &stats->fase_cycles);
+    summarizeHistogram(Atlas::kFaseFlushesHistogram, &stats->fase_flushes);
+    summarizeHistogram(Atlas::kEndFaseFlushCyclesHistogram,
+                       &stats->end_fase_flush_cycles);
+}
+
+void NVM_PrintHistograms()
+{
+    Atlas::StatsRegistry::printHistograms();
+}
+
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <iostream>
+#include <cassert>
+#include <cerrno>
+
+#include <time.h>
+
+#include "log_mgr.hpp"
+#include "internal_api.h"
+
+namespace Atlas {
+
+///
+/// @brief Create the thread returning freed memory to the OS
+///    
+void LogMgr::startReclaimer()
+{
+    IsReclaimerDone_ = false;
+    int status = pthread_create(&ReclaimerThread_, nullptr,
+                                reclaimer, this);
+    assert(!status);
+}
+
+///
+/// @brief Wake up the reclaimer thread and join it
+///    
+void LogMgr::stopReclaimer()
+{
+    pthread_mutex_lock(&ReclaimerLock_);
+    IsReclaimerDone_ = true;
+    pthread_cond_signal(&ReclaimerCondition_);
+    pthread_mutex_unlock(&ReclaimerLock_);
+
+    int status = pthread_join(ReclaimerThread_, nullptr);
+    assert(!status);
+}
+
+///
+/// @brief Return the pages of the circular buffers that were emptied
+/// and are not reused yet to the OS. A buffer is claimed before its
+/// pages are returned so that its owner does not reuse it meanwhile.
+/// @return The number of bytes returned
+///    
+size_t LogMgr::reclaimLogBuffers()
+{
+    size_t reclaimed = 0;
+    CbListNode<LogEntry> *curr = CbLogList_.load(std::memory_order_acquire);
+    for (; curr; curr = curr->Next) {
+        uint32_t state = kCbAvailable;
+        if (!curr->isAvailable.compare_exchange_strong(
+                state, kCbReclaiming, std::memory_order_acquire))
+            continue;
+        reclaimed += PRegionMgr::getInstance().punchHole(
+            curr->StartAddr, curr->EndAddr - curr->StartAddr + 1);
+        curr->isAvailable.store(kCbReclaimed, std::memory_order_release);
+    }
+    return reclaimed;
+}
+
+///
+/// @brief Entry point of the reclaimer thread. Every
+/// kReclaimIntervalMs, the whole pages of free chunks of the open
+/// regions and of emptied log buffers are returned to the OS.
+///    
+void *LogMgr::reclaimer(void *arg)
+{
+    LogMgr *log_mgr = static_cast<LogMgr*>(arg);
+    pthread_mutex_lock(&log_mgr->ReclaimerLock_);
+    while (!log_mgr->IsReclaimerDone_) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += kReclaimIntervalMs / 1000;
+        deadline.tv_nsec += (kReclaimIntervalMs % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        int status = 0;
+        while (!log_mgr->IsReclaimerDone_ && status != ETIMEDOUT)
+            status = pthread_cond_timedwait(&log_mgr->ReclaimerCondition_,
+                                            &log_mgr->ReclaimerLock_,
+                                            &deadline);
+        if (log_mgr->IsReclaimerDone_) break;
+        pthread_mutex_unlock(&log_mgr->ReclaimerLock_);
+
+        size_t reclaimed = PRegionMgr::getInstance().reclaimFreeMem() +
+            log_mgr->reclaimLogBuffers();
+        log_mgr->ReclaimedBytes_.fetch_add(
+            reclaimed, std::memory_order_relaxed);
+#if defined(_MSYNC_DURABILITY)
+        // The chunks cleared above
+        nvm_sync_dirty_pages();
+#endif
+
+        pthread_mutex_lock(&log_mgr->ReclaimerLock_);
+    }
+    pthread_mutex_unlock(&log_mgr->ReclaimerLock_);
+
+#if defined(NVM_STATS)
+    log_mgr->acquireStatsLock();
+    std::cout << "[Atlas-reclaimer] Bytes returned to the OS: " <<
+        log_mgr->get_reclaimed_bytes() << std::endl;
+    log_mgr->releaseStatsLock();
+#endif
+    return nullptr;
+}
+
+} // namespace Atlas
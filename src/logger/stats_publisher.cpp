@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <utility>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "log_mgr.hpp"
+
+namespace Atlas {
+
+// Samples kept to tell the age of the oldest FASE not pruned yet
+const size_t kMaxStatsHistory = 4096;
+
+static uint64_t getMonotonicTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+///
+/// @brief Map the stats page and create the thread updating it. Not
+/// being able to publish stats is not fatal.
+///    
+void LogMgr::startStatsPublisher()
+{
+    char *path = NVM_GetStatsPagePath();
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    size_t sz = (sizeof(StatsPage) + kPageSize_ - 1) & ~(kPageSize_ - 1);
+    void *addr = MAP_FAILED;
+    if (fd != -1 && !ftruncate(fd, sz))
+        addr = mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd != -1) close(fd);
+    if (addr == MAP_FAILED) {
+        perror("[Atlas] stats page");
+        unlink(path);
+        free(path);
+        return;
+    }
+    free(path);
+
+    StatsPage_ = new (addr) StatsPage;
+    StatsPage_->Seq_.store(0, std::memory_order_relaxed);
+    StatsPage_->Magic_ = kStatsPageMagic;
+
+    IsStatsPublisherDone_ = false;
+    int status = pthread_create(&StatsPublisherThread_, nullptr,
+                                statsPublisher, this);
+    assert(!status);
+}
+
+///
+/// @brief Join the thread updating the stats page and remove the page
+///    
+void LogMgr::stopStatsPublisher()
+{
+    if (!StatsPage_) return;
+
+    pthread_mutex_lock(&StatsPublisherLock_);
+    IsStatsPublisherDone_ = true;
+    pthread_cond_signal(&StatsPublisherCondition_);
+    pthread_mutex_unlock(&StatsPublisherLock_);
+
+    int status = pthread_join(StatsPublisherThread_, nullptr);
+    assert(!status);
+
+    munmap(StatsPage_,
+           (sizeof(StatsPage) + kPageSize_ - 1) & ~(kPageSize_ - 1));
+    StatsPage_ = nullptr;
+    char *path = NVM_GetStatsPagePath();
+    unlink(path);
+    free(path);
+}
+
+///
+/// @brief Entry point of the stats publisher thread. Every
+/// kStatsPageIntervalMs, a snapshot of the stats registry is written
+/// to the stats page. The age of the oldest FASE not pruned yet is
+/// derived from the history of the number of FASEs: it ended after
+/// the last sample taken when all FASEs so far were pruned.
+///    
+void *LogMgr::statsPublisher(void *arg)
+{
+    LogMgr *log_mgr = static_cast<LogMgr*>(arg);
+    std::deque<std::pair<uint64_t /* time */, uint64_t /* FASEs */> >
+        history;
+    history.push_back(std::make_pair(getMonotonicTimeNs(), 0));
+
+    StatsSample sample;
+    sample.Pid = getpid();
+    
+    pthread_mutex_lock(&log_mgr->StatsPublisherLock_);
+    while (!log_mgr->IsStatsPublisherDone_) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += kStatsPageIntervalMs / 1000;
+        deadline.tv_nsec += (kStatsPageIntervalMs % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000;
+        }
+        int status = 0;
+        while (!log_mgr->IsStatsPublisherDone_ && status != ETIMEDOUT)
+            status = pthread_cond_timedwait(
+                &log_mgr->StatsPublisherCondition_,
+                &log_mgr->StatsPublisherLock_, &deadline);
+        if (log_mgr->IsStatsPublisherDone_) break;
+        pthread_mutex_unlock(&log_mgr->StatsPublisherLock_);
+
+        StatsRegistry::getSnapshot(sample.Counters);
+        sample.TimeNs = getMonotonicTimeNs();
+
+        uint64_t pruned = sample.Counters[kPrunedFaseCount];
+        history.push_back(
+            std::make_pair(sample.TimeNs, sample.Counters[kFaseCount]));
+        while (history.size() > 1 && history[1].second <= pruned)
+            history.pop_front();
+        // The helper thread may be stuck behind a FASE that never
+        // ends. The oldest sample is kept for the age, at the cost of
+        // precision later on.
+        if (history.size() > kMaxStatsHistory)
+            history.erase(history.begin() + 1);
+        sample.HelperLagNs = history.back().second <= pruned ? 0 :
+            sample.TimeNs - history.front().first;
+
+        log_mgr->StatsPage_->write(sample);
+
+        pthread_mutex_lock(&log_mgr->StatsPublisherLock_);
+    }
+    pthread_mutex_unlock(&log_mgr->StatsPublisherLock_);
+    return nullptr;
+}
+
+} // namespace Atlas
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+
+#include <cstdio>
+#include <cassert>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/vfs.h>
+
+#include "pextent.hpp"
+#include "pmalloc_util.hpp"
+#include "internal_api.h"
+#include "atlas_alloc.h"
+
+namespace Atlas {
+
+///
+/// Rebuild the transient view of the extent arena from the
+/// descriptor table. Must be called once the region is mapped.
+///
+void PExtentArena::initTransients(int fd)
+{
+    pthread_mutex_init(&Lock_, NULL);
+    FileDesc_ = fd;
+    // Holes are punched in whole blocks, e.g. huge pages on hugetlbfs
+    struct statfs fs_buffer;
+    PunchAlign_ = fd != -1 && !fstatfs(fd, &fs_buffer) ?
+        fs_buffer.f_bsize : kPageSize_;
+    Transients_ = new PExtentTransients;
+
+    std::map<char*, size_t> alloced;
+    // Push in reverse so that low descriptors are handed out first
+    for (uint32_t i = MaxNumExtents_; i > 0; --i) {
+        PExtent *ext = getExtent(i - 1);
+        if (!ext->IsAllocated_) {
+            Transients_->FreeDescs_.push_back(i - 1);
+            continue;
+        }
+        Transients_->Alloced_.insert(std::make_pair(ext->Addr_, i - 1));
+        alloced.insert(std::make_pair(static_cast<char*>(ext->Addr_),
+                                      get_extent_size(ext->Size_)));
+    }
+
+    char *zero_start = std::max(get_first_extent_addr(),
+                                static_cast<char*>(ZeroAddr_));
+    if (zero_start < static_cast<char*>(EndAddr_))
+        insertRange(&Transients_->ZeroRanges_, zero_start,
+                    static_cast<char*>(EndAddr_) - zero_start);
+
+    char *free_start = get_first_extent_addr();
+    for (auto & ext : alloced) {
+        if (ext.first > free_start)
+            insertFreeRange(free_start, ext.first - free_start);
+        free_start = ext.first + ext.second;
+    }
+    if (free_start < static_cast<char*>(EndAddr_))
+        insertFreeRange(free_start, static_cast<char*>(EndAddr_) - free_start);
+}
+
+///
+/// Given a size, allocate an extent using first fit. The extent is
+/// aligned to at least min_align, a power of 2. Return null if no
+/// descriptor or no sufficiently large range is available. If
+/// is_zeroed is given, it is set to whether the extent is known to
+/// read as zero.
+///
+void *PExtentArena::allocMem(
+    size_t sz, bool does_need_logging, size_t min_align, bool *is_zeroed)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    size_t ext_sz = get_extent_size(sz);
+    uintptr_t align = get_extent_alignment(sz);
+    if (min_align > align) align = min_align;
+
+    Lock();
+    if (Transients_->FreeDescs_.empty()) {
+        Unlock();
+        return nullptr;
+    }
+
+    char *ext_addr = nullptr;
+    std::map<char*, size_t> & free_ranges = Transients_->FreeRanges_;
+    for (auto ci = free_ranges.begin(); ci != free_ranges.end(); ++ci) {
+        char *start = ci->first;
+        char *end = start + ci->second;
+        char *aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(start) + align - 1) & ~(align - 1));
+        if (aligned + ext_sz > end) continue;
+
+        free_ranges.erase(ci);
+        if (aligned > start) insertFreeRange(start, aligned - start);
+        if (aligned + ext_sz < end)
+            insertFreeRange(aligned + ext_sz, end - aligned - ext_sz);
+        ext_addr = aligned;
+        break;
+    }
+    if (!ext_addr) {
+        Unlock();
+        return nullptr;
+    }
+    cancelPendingPunches(ext_addr, ext_sz);
+
+    if (is_zeroed) *is_zeroed = isZeroRange(ext_addr, ext_sz);
+    eraseRange(&Transients_->ZeroRanges_, ext_addr, ext_sz);
+
+    // The extent may be written as soon as it is handed out
+    if (ext_addr + ext_sz > static_cast<char*>(ZeroAddr_)) {
+        ZeroAddr_ = static_cast<void*>(ext_addr + ext_sz);
+        PMallocUtil::flush_line(&ZeroAddr_);
+    }
+
+    uint32_t index = Transients_->FreeDescs_.back();
+    Transients_->FreeDescs_.pop_back();
+    PExtent *ext = getExtent(index);
+
+    ext->Addr_ = static_cast<void*>(ext_addr);
+    ext->Size_ = sz;
+
+    // If we fail here or anywhere above, the descriptor is not
+    // considered allocated and no memory is leaked
+
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging) nvm_log_alloc(&ext->IsAllocated_);
+#endif
+
+    ext->IsAllocated_ = true;
+
+    // A descriptor never crosses a cache line
+    assert(!isOnDifferentCacheLine(ext, &ext->Unused_));
+
+    // Also completes the flush of ZeroAddr_
+    PMallocUtil::flush_line(ext);
+    PMallocUtil::drain_flushes();
+
+    Transients_->Alloced_.insert(std::make_pair(ext->Addr_, index));
+    incrementActualAllocedStats(ext_sz);
+
+    Unlock();
+
+    // Only a hint, the extent is usable either way
+    if (align >= kHugePageSize_) madvise(ext_addr, ext_sz, MADV_HUGEPAGE);
+
+    return static_cast<void*>(ext_addr);
+}
+
+///
+/// Given a pointer to an extent, mark it free and return its range to
+/// the arena. Its pages are given back to the OS right away unless the
+/// free is logged, in which case the contents must survive until the
+/// enclosing FASE is committed.
+///
+void PExtentArena::freeMem(void *ptr, bool should_log)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    Lock();
+
+    uint32_t index = findExtent(ptr);
+    PExtent *ext = getExtent(index);
+    assert(ext->IsAllocated_ && "free called on unallocated memory");
+
+    bool is_logged = false;
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (should_log) is_logged = nvm_log_free(&ext->IsAllocated_);
+#endif
+
+    ext->IsAllocated_ = false;
+    PMallocUtil::flush_line(&ext->IsAllocated_);
+    PMallocUtil::drain_flushes();
+
+    size_t ext_sz = get_extent_size(ext->Size_);
+    Transients_->Alloced_.erase(ptr);
+    insertFreeRange(static_cast<char*>(ptr), ext_sz);
+    decrementActualAllocedStats(ext_sz);
+
+    // The descriptor is kept as is until the free is committed since
+    // undoing the free needs it
+    if (is_logged) Transients_->PendingFrees_[index] = true;
+    else {
+        if (punchHole(ptr, ext_sz))
+            insertRange(&Transients_->ZeroRanges_,
+                        static_cast<char*>(ptr), ext_sz);
+        Transients_->FreeDescs_.push_back(index);
+    }
+
+    Unlock();
+}
+
+///
+/// Resize an extent without moving it if the new size needs the
+/// same pages. Returns false if the extent must be moved.
+///
+bool PExtentArena::reallocInPlace(
+    void *ptr, size_t sz, bool does_need_logging)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    Lock();
+    PExtent *ext = getExtent(findExtent(ptr));
+    if (sz < kExtentThreshold_ ||
+        get_extent_size(sz) != get_extent_size(ext->Size_)) {
+        Unlock();
+        return false;
+    }
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging) nvm_store(&ext->Size_, sizeof(size_t)*8);
+#endif
+    ext->Size_ = sz;
+    NVM_FLUSH(&ext->Size_);
+    Unlock();
+    return true;
+}
+
+///
+/// Called once the free of the given descriptor is committed. The
+/// descriptor can be reused from now on, and the pages can be
+/// returned to the OS unless the range was handed out again.
+///
+void PExtentArena::completeFree(void *is_allocated_addr)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    uint32_t index = (static_cast<char*>(is_allocated_addr) -
+                      static_cast<char*>(StartAddr_)) / sizeof(PExtent);
+    Lock();
+    auto ci = Transients_->PendingFrees_.find(index);
+    if (ci != Transients_->PendingFrees_.end()) {
+        PExtent *ext = getExtent(index);
+        size_t ext_sz = get_extent_size(ext->Size_);
+        if (ci->second && punchHole(ext->Addr_, ext_sz))
+            insertRange(&Transients_->ZeroRanges_,
+                        static_cast<char*>(ext->Addr_), ext_sz);
+        Transients_->PendingFrees_.erase(ci);
+        Transients_->FreeDescs_.push_back(index);
+    }
+    Unlock();
+}
+
+size_t PExtentArena::getAllocSize(void *ptr)
+{
+    Lock();
+    size_t sz = getExtent(findExtent(ptr))->Size_;
+    Unlock();
+    return sz;
+}
+
+///
+/// Append the page ranges holding data, i.e. the descriptor table and
+/// the allocated extents, in address order
+///
+void PExtentArena::getPopulatedRanges(
+    std::vector<std::pair<char*, size_t> > *ranges)
+{
+    char *table_end = reinterpret_cast<char*>(getExtent(MaxNumExtents_));
+    ranges->push_back(std::make_pair(
+        static_cast<char*>(StartAddr_),
+        (table_end - static_cast<char*>(StartAddr_) + kPageSize_ - 1) &
+        ~(kPageSize_ - 1)));
+    Lock();
+    for (auto & ext : Transients_->Alloced_)
+        ranges->push_back(std::make_pair(
+            static_cast<char*>(ext.first),
+            get_extent_size(getExtent(ext.second)->Size_)));
+    Unlock();
+}
+
+///
+/// Append the part of the arena that may hold data, i.e. up to where
+/// extents were ever handed out, including extents freed since. The
+/// lock must be held.
+///
+void PExtentArena::getWrittenRanges(
+    std::vector<std::pair<char*, size_t> > *ranges) const
+{
+    char *end = ZeroAddr_ ? static_cast<char*>(ZeroAddr_) :
+        reinterpret_cast<char*>(getExtent(MaxNumExtents_));
+    ranges->push_back(std::make_pair(
+        static_cast<char*>(StartAddr_),
+        (end - static_cast<char*>(StartAddr_) + kPageSize_ - 1) &
+        ~(kPageSize_ - 1)));
+}
+
+///
+/// Return the descriptor index of an allocated extent. The lock must
+/// be held.
+///
+uint32_t PExtentArena::findExtent(void *ptr) const
+{
+    auto ci = Transients_->Alloced_.find(ptr);
+    assert(ci != Transients_->Alloced_.end() &&
+           "Pointer is not the start of an allocated extent!");
+    return ci->second;
+}
+
+///
+/// Add a range to a set of disjoint ranges, coalescing with its
+/// neighbors. The lock must be held.
+///
+void PExtentArena::insertRange(
+    std::map<char*, size_t> *ranges, char *start, size_t sz)
+{
+    auto next = ranges->lower_bound(start);
+    if (next != ranges->end() && start + sz == next->first) {
+        sz += next->second;
+        next = ranges->erase(next);
+    }
+    if (next != ranges->begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == start) {
+            prev->second += sz;
+            return;
+        }
+    }
+    ranges->insert(next, std::make_pair(start, sz));
+}
+
+///
+/// Remove a range from a set of disjoint ranges, splitting the ones
+/// it partially overlaps. The lock must be held.
+///
+void PExtentArena::eraseRange(
+    std::map<char*, size_t> *ranges, char *start, size_t sz)
+{
+    char *end = start + sz;
+    auto ci = ranges->lower_bound(start);
+    if (ci != ranges->begin() && std::prev(ci)->first +
+        std::prev(ci)->second > start) --ci;
+    while (ci != ranges->end() && ci->first < end) {
+        char *r_start = ci->first;
+        char *r_end = r_start + ci->second;
+        ci = ranges->erase(ci);
+        if (r_start < start) ranges->insert(
+            std::make_pair(r_start, static_cast<size_t>(start - r_start)));
+        if (r_end > end) ranges->insert(
+            std::make_pair(end, static_cast<size_t>(r_end - end)));
+    }
+}
+
+bool PExtentArena::isZeroRange(char *start, size_t sz) const
+{
+    const std::map<char*, size_t> & zero_ranges = Transients_->ZeroRanges_;
+    auto ci = zero_ranges.upper_bound(start);
+    if (ci == zero_ranges.begin()) return false;
+    --ci;
+    return start + sz <= ci->first + ci->second;
+}
+
+///
+/// A range being handed out again must not be punched when an
+/// earlier free of an overlapping extent commits. The lock must be
+/// held.
+///
+void PExtentArena::cancelPendingPunches(char *start, size_t sz)
+{
+    for (auto & pending : Transients_->PendingFrees_) {
+        if (!pending.second) continue;
+        PExtent *ext = getExtent(pending.first);
+        char *ext_start = static_cast<char*>(ext->Addr_);
+        if (ext_start < start + sz &&
+            start < ext_start + get_extent_size(ext->Size_))
+            pending.second = false;
+    }
+}
+
+///
+/// Return the pages backing a free range to the OS. If successful,
+/// the range reads as zero afterwards.
+///
+bool PExtentArena::punchHole(void *addr, size_t sz) const
+{
+    // The region file starts with the arenas, which take as much
+    // space as the extents
+    off_t offset = static_cast<char*>(addr) -
+        static_cast<char*>(StartAddr_) +
+        (static_cast<char*>(EndAddr_) - static_cast<char*>(StartAddr_));
+    // A partially covered block would be left in place, not zeroed
+    if (offset % PunchAlign_ || sz % PunchAlign_) return false;
+    return PMallocUtil::punch_hole(FileDesc_, offset, addr, sz);
+}
+
+} // namespace Atlas
@@ -19,8 +19,13 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <utility>
 
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
 #include "pmalloc.hpp"
 #include "pmalloc_util.hpp"
 #include "internal_api.h"
@@ -30,7 +35,79 @@ namespace Atlas {
 
 uint32_t PMallocUtil::CacheLineSize_{UINT32_MAX};
 uintptr_t PMallocUtil::CacheLineMask_{UINTPTR_MAX};
-thread_local uint32_t PMallocUtil::TL_CurrArena_[kMaxNumPRegions_] = {};
+uint32_t PMallocUtil::NumNumaNodes_{1};
+thread_local uint8_t PMallocUtil::TL_CurrArena_[kMaxNumPRegions_] = {};
+
+static uint64_t getInitialArenaEpoch()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (ts.tv_sec * 1000000000ULL + ts.tv_nsec) << 1;
+}
+
+///
+/// Return an epoch for a new mapping of a region. Epochs are even and
+/// start from the time of the first call in this process, so that an
+/// epoch left in the region table by an earlier mapping or process is
+/// never handed out again.
+///
+uint64_t PMallocUtil::get_next_arena_epoch()
+{
+    static std::atomic<uint64_t> next_epoch{getInitialArenaEpoch()};
+    return next_epoch.fetch_add(2, std::memory_order_relaxed);
+}
+
+///
+/// Return the pages of a range, found at the given offset of the
+/// region file, to the OS. They read as zero afterwards. Returns false
+/// if the pages are kept.
+///
+bool PMallocUtil::punch_hole(int fd, off_t offset, void *addr, size_t sz)
+{
+    // The region file is preallocated on this platform and must stay so
+#if !defined(_NVDIMM_PROLIANT)
+    if (fd != -1 &&
+        !fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   offset, sz))
+        return true;
+    // Not fatal: the pages are merely kept around
+    if (!madvise(addr, sz, MADV_REMOVE)) return true;
+    perror("madvise");
+#endif
+    return false;
+}
+
+///
+/// Set up the transients of the arena for the given epoch unless
+/// another thread is doing so, in which case wait for it
+///
+void PArena::initTransients(uint64_t epoch)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    uint64_t curr = Epoch_.load(std::memory_order_acquire);
+    while (curr != epoch) {
+        if (curr == epoch + 1) {
+            sched_yield();
+            curr = Epoch_.load(std::memory_order_acquire);
+            continue;
+        }
+        // Whatever is there is stale, including a set up that an
+        // earlier process did not finish
+        if (!Epoch_.compare_exchange_weak(
+                curr, epoch + 1, std::memory_order_acquire)) continue;
+        
+        pthread_mutex_init(&Lock_, NULL);
+        FreeList_ = new FreeList;
+        PendingFrees_ = new PendingFreeMap;
+        ContentionCount_.store(0, std::memory_order_relaxed);
+        RemoteFrees_.store(nullptr, std::memory_order_relaxed);
+        NumRemoteFrees_.store(0, std::memory_order_relaxed);
+        Epoch_.store(epoch, std::memory_order_release);
+        return;
+    }
+}
 
 ///
 /// Given a pointer to persistent memory, mark the location free and
@@ -57,11 +134,14 @@ void PArena::freeMem(void *ptr, bool should_log)
            "Attempt to free memory outside of arena range!");
     
 #ifndef _DISABLE_ALLOC_LOGGING
-    if (should_log) nvm_log_free(mem + sizeof(size_t));
+    // An elided free is never pruned, so it must not be pending
+    if (should_log && nvm_log_free(mem + sizeof(size_t)))
+        notePendingFree(mem);
 #endif
     
     *(size_t*)(mem + sizeof(size_t)) = false;
-    NVM_FLUSH(mem + sizeof(size_t));
+    PMallocUtil::flush_line(mem + sizeof(size_t));
+    PMallocUtil::drain_flushes();
     
     insertToFreeList(PMallocUtil::get_bin_number(
                          PMallocUtil::get_requested_alloc_size_from_ptr(ptr)), 
@@ -70,16 +150,249 @@ void PArena::freeMem(void *ptr, bool should_log)
     decrementActualAllocedStats(
         PMallocUtil::get_actual_alloc_size(
             PMallocUtil::get_requested_alloc_size_from_ptr(ptr)));
+
+    if (hasRemoteFrees()) drainRemoteFrees();
     
     Unlock();
 }
 
+///
+/// Free a chunk on behalf of a thread that does not own this arena
+/// without acquiring the arena lock. The persistent part of the free
+/// (logging and clearing the is-allocated word) is done right away;
+/// only the transient free list insertion is deferred to the next
+/// thread holding the lock. The queue is linked through the bodies of
+/// the freed chunks.
+///    
+void PArena::freeRemoteMem(void *ptr, bool should_log)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    assert(PMallocUtil::is_ptr_allocated(ptr) &&
+           "free called on unallocated memory");
+
+    char *mem = (char*)PMallocUtil::ptr2mem(ptr);
+    assert(doesRangeCheck(mem, *(reinterpret_cast<size_t*>(mem))) &&
+           "Attempt to free memory outside of arena range!");
+
+    // A body too small to hold the link is freed under the lock
+    if (PMallocUtil::get_actual_alloc_size(
+            PMallocUtil::get_requested_alloc_size_from_mem(mem)) -
+        PMallocUtil::get_metadata_size() < sizeof(RemoteFree)) {
+        freeMem(ptr, should_log);
+        return;
+    }
+    
+    bool is_logged = false;
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (should_log) is_logged = nvm_log_free(mem + sizeof(size_t));
+    // Undoing the free must bring back what the link overwrites
+    if (is_logged) nvm_memcpy(ptr, sizeof(RemoteFree));
+#endif
+
+    // Publish the chunk before marking it free. A lock holder that
+    // observes the chunk free is then guaranteed to find it in the
+    // queue when it drains.
+    RemoteFree *node = static_cast<RemoteFree*>(ptr);
+    node->IsLogged_ = is_logged;
+    pushRemoteFree(node);
+
+    *(size_t*)(mem + sizeof(size_t)) = false;
+    PMallocUtil::flush_line(mem + sizeof(size_t));
+    PMallocUtil::drain_flushes();
+
+    // If the owner is not allocating, drain on its behalf
+    if (NumRemoteFrees_.fetch_add(1, std::memory_order_relaxed) + 1 >=
+        kRemoteFreeBatch_ && !tryLock()) {
+        drainRemoteFrees();
+        Unlock();
+    }
+}
+
+///
+/// Mark a group of chunks of this arena free and add them to the
+/// free list under a single lock acquisition. The chunks must be in
+/// address order. Logging is done by the caller, once for the group.
+///    
+void PArena::freeMemBatch(void *const *ptrs, size_t n, bool is_logged)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    Lock();
+
+    for (size_t i = 0; i < n; ++i) {
+        void *ptr = ptrs[i];
+        assert(PMallocUtil::is_ptr_allocated(ptr) &&
+               "free called on unallocated memory");
+
+        char *mem = (char*)PMallocUtil::ptr2mem(ptr);
+        assert(doesRangeCheck(mem, *(reinterpret_cast<size_t*>(mem))) &&
+               "Attempt to free memory outside of arena range!");
+
+        size_t sz = PMallocUtil::get_requested_alloc_size_from_mem(mem);
+        if (is_logged) notePendingFree(mem);
+        *(size_t*)(mem + sizeof(size_t)) = false;
+
+        insertToFreeList(PMallocUtil::get_bin_number(sz), mem);
+        decrementActualAllocedStats(PMallocUtil::get_actual_alloc_size(sz));
+    }
+    flushChunkHeaders(ptrs, n);
+    PMallocUtil::drain_flushes();
+
+    if (hasRemoteFrees()) drainRemoteFrees();
+    
+    Unlock();
+}
+
+///
+/// Move all chunks in the remote-free queue to the free list. The
+/// arena lock must be held.
+///    
+void PArena::drainRemoteFrees()
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    RemoteFree *curr = RemoteFrees_.exchange(
+        nullptr, std::memory_order_acquire);
+    uint32_t count = 0;
+    while (curr) {
+        // The link is dead once the chunk is on the free list
+        RemoteFree *next = curr->Next_;
+        char *mem = static_cast<char*>(PMallocUtil::ptr2mem(curr));
+
+        // The freeing thread has not cleared the word yet, leave the
+        // chunk to a later drain
+        if (PMallocUtil::is_mem_allocated(mem)) pushRemoteFree(curr);
+        else {
+            size_t sz = PMallocUtil::get_requested_alloc_size_from_mem(mem);
+            decrementActualAllocedStats(
+                PMallocUtil::get_actual_alloc_size(sz));
+            if (curr->IsLogged_) notePendingFree(mem);
+            insertToFreeList(PMallocUtil::get_bin_number(sz), mem);
+            ++count;
+        }
+        curr = next;
+    }
+    NumRemoteFrees_.fetch_sub(count, std::memory_order_relaxed);
+}
+
+///
+/// Record a logged free of a chunk. The arena lock must be held.
+///    
+void PArena::notePendingFree(void *mem)
+{
+#if defined(_RECLAIM_MEMORY)
+    ++(*PendingFrees_)[mem];
+#endif
+}
+
+///
+/// Called by the helper thread once a logged free of a chunk is
+/// committed
+///    
+void PArena::completeFree(void *mem)
+{
+#if defined(_RECLAIM_MEMORY)
+    Lock();
+    // The free may still be queued
+    if (hasRemoteFrees()) drainRemoteFrees();
+    PendingFreeMap::iterator ci = PendingFrees_->find(mem);
+    if (ci != PendingFrees_->end() && !--ci->second) PendingFrees_->erase(ci);
+    Unlock();
+#endif
+}
+
+///
+/// Return the whole pages in the bodies of free chunks to the OS and
+/// clear the rest of the bodies, so that the chunks read as zero when
+/// handed out again. The region file starts at file_start. An arena
+/// in use is skipped. Returns the number of bytes returned.
+///    
+size_t PArena::reclaimFreeMem(int fd, void *file_start, size_t punch_align)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    // Not counted as contention
+    if (pthread_mutex_trylock(&Lock_)) return 0;
+    if (hasRemoteFrees()) drainRemoteFrees();
+
+    size_t reclaimed = 0;
+    for (FreeList::value_type & bin : *FreeList_) {
+        for (MemMap::value_type & chunk : bin.second) {
+            char *mem = static_cast<char*>(chunk.first);
+            if (chunk.second || PMallocUtil::is_mem_allocated(mem) ||
+                PendingFrees_->count(mem)) continue;
+            
+            char *body = mem + PMallocUtil::get_metadata_size();
+            char *end = mem + PMallocUtil::get_actual_alloc_size(
+                PMallocUtil::get_requested_alloc_size_from_mem(mem));
+            char *hole = reinterpret_cast<char*>(
+                (reinterpret_cast<uintptr_t>(body) + punch_align - 1) &
+                ~(punch_align - 1));
+            char *hole_end = reinterpret_cast<char*>(
+                reinterpret_cast<uintptr_t>(end) & ~(punch_align - 1));
+            if (hole_end <= hole) continue;
+            if (!PMallocUtil::punch_hole(
+                    fd, hole - static_cast<char*>(file_start),
+                    hole, hole_end - hole))
+                continue;
+
+            clearRange(body, hole - body);
+            clearRange(hole_end, end - hole_end);
+            chunk.second = true;
+            reclaimed += hole_end - hole;
+        }
+    }
+    PMallocUtil::drain_flushes();
+    
+    Unlock();
+    return reclaimed;
+}
+
+///
+/// Append the page ranges of the allocated chunks, in address order.
+/// Free chunks are skipped so that touching the ranges does not undo
+/// the reclaiming of their bodies.
+///    
+void PArena::getAllocatedRanges(
+    std::vector<std::pair<char*, size_t> > *ranges)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    Lock();
+    char *mem = static_cast<char*>(StartAddr_);
+    while (mem < static_cast<char*>(CurrAllocAddr_)) {
+        char *end = mem + PMallocUtil::get_actual_alloc_size(
+            PMallocUtil::get_requested_alloc_size_from_mem(mem));
+        if (PMallocUtil::is_mem_allocated(mem)) {
+            char *page = reinterpret_cast<char*>(
+                reinterpret_cast<uintptr_t>(mem) & ~(kPageSize_ - 1));
+            char *page_end = reinterpret_cast<char*>(
+                (reinterpret_cast<uintptr_t>(end) + kPageSize_ - 1) &
+                ~(kPageSize_ - 1));
+            if (!ranges->empty() &&
+                ranges->back().first + ranges->back().second >= page)
+                ranges->back().second = page_end - ranges->back().first;
+            else ranges->push_back(std::make_pair(page, page_end - page));
+        }
+        mem = end;
+    }
+    Unlock();
+}
+
 ///
 /// Given a size, allocate memory using the bump pointer. If it
-/// reaches the end of the arena, return null.
+/// reaches the end of the arena, return null. If is_zeroed is given,
+/// it is set to whether the memory is known to read as zero.
 ///    
 void *PArena::allocMem(
-    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging)
+    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging,
+    bool *is_zeroed)
 {
 #ifdef _FORCE_FAIL
     fail_program();
@@ -122,20 +435,21 @@ void *PArena::allocMem(
             assert(!isOnDifferentCacheLine(
                        curr_alloc_addr_c, curr_alloc_addr_c + sizeof(size_t)));
 
-            NVM_FLUSH(curr_alloc_addr_c);
+            PMallocUtil::flush_line(curr_alloc_addr_c);
 
+            // The fragment and the allocation below are published by
+            // the same bump pointer update. If we fail before it,
+            // both are beyond the bump pointer and hence unallocated.
             insertToFreeList(PMallocUtil::get_bin_number(
                                  diff - PMallocUtil::get_metadata_size()), 
                              curr_alloc_addr_c);
-            CurrAllocAddr_ = reinterpret_cast<void*>(
+            curr_alloc_addr_c = reinterpret_cast<char*>(
                 next_cache_line - PMallocUtil::get_metadata_size());
-            NVM_FLUSH(&CurrAllocAddr_);
-            curr_alloc_addr_c = static_cast<char*>(CurrAllocAddr_);
         }
     }
     if ((curr_alloc_addr_c + alloc_sz - 1) < static_cast<char*>(EndAddr_))
     {
-        *(static_cast<size_t*>(CurrAllocAddr_)) = sz;
+        *(reinterpret_cast<size_t*>(curr_alloc_addr_c)) = sz;
 
 #ifndef _DISABLE_ALLOC_LOGGING
         if (does_need_logging) nvm_log_alloc(
@@ -149,12 +463,15 @@ void *PArena::allocMem(
         assert(!isOnDifferentCacheLine(
                    curr_alloc_addr_c, curr_alloc_addr_c + sizeof(size_t)));
 
-        NVM_FLUSH(curr_alloc_addr_c);
+        PMallocUtil::flush_line(curr_alloc_addr_c);
 
         // If we fail somewhere above, the above memory will be
-        // considered unallocated because CurrAllocAddr_ is not yet set.
+        // considered unallocated because CurrAllocAddr_ is not yet
+        // set. The flush above is ordered before the store below, so
+        // a single fence makes both durable.
         CurrAllocAddr_ = static_cast<void*>(curr_alloc_addr_c + alloc_sz);
-        NVM_FLUSH(&CurrAllocAddr_);
+        PMallocUtil::flush_line(&CurrAllocAddr_);
+        PMallocUtil::drain_flushes();
 
         // If we fail here or later, the above memory may be leaked.
 
@@ -163,6 +480,8 @@ void *PArena::allocMem(
                        curr_alloc_addr_c + PMallocUtil::get_metadata_size()));
 
         incrementActualAllocedStats(alloc_sz);
+
+        if (is_zeroed) *is_zeroed = curr_alloc_addr_c >= DirtyEndAddr_;
         
         return static_cast<void*>(
             curr_alloc_addr_c + PMallocUtil::get_metadata_size());
@@ -170,12 +489,67 @@ void *PArena::allocMem(
     return nullptr;
 }
 
+///
+/// Given an array of sizes, carve as many of them as fit, in order,
+/// out of the bump pointer as one contiguous run. The run is covered
+/// by a single log record and its headers are flushed together. The
+/// lock must already be held. Returns the number of chunks carved.
+///    
+size_t PArena::allocMemBatch(
+    const size_t *sizes, size_t n, void **out, bool does_need_logging)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    char *start = static_cast<char*>(CurrAllocAddr_);
+    char *end = start;
+    size_t count = 0;
+    for (; count < n; ++count) {
+        size_t alloc_sz = PMallocUtil::get_actual_alloc_size(sizes[count]);
+        if ((end + alloc_sz - 1) >= static_cast<char*>(EndAddr_)) break;
+        end += alloc_sz;
+    }
+    if (!count) return 0;
+
+    // The headers below are written past the bump pointer, so the
+    // extent of the run must be durable first
+    if (end > DirtyEndAddr_) {
+        DirtyEndAddr_ = static_cast<void*>(end);
+        PMallocUtil::flush_line(&DirtyEndAddr_);
+    }
+
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging) nvm_log_alloc_batch(start, end - start);
+#endif
+
+    char *mem = start;
+    for (size_t i = 0; i < count; ++i) {
+        *(reinterpret_cast<size_t*>(mem)) = sizes[i];
+        *(reinterpret_cast<size_t*>(mem + sizeof(size_t))) = true;
+        out[i] = static_cast<void*>(mem + PMallocUtil::get_metadata_size());
+        mem += PMallocUtil::get_actual_alloc_size(sizes[i]);
+    }
+    flushChunkHeaders(out, count);
+
+    // If we fail somewhere above, the whole run will be considered
+    // unallocated because CurrAllocAddr_ is not yet set.
+    CurrAllocAddr_ = static_cast<void*>(end);
+    PMallocUtil::flush_line(&CurrAllocAddr_);
+    PMallocUtil::drain_flushes();
+
+    incrementActualAllocedStats(end - start);
+    
+    return count;
+}
+
 ///
 /// Given a size, allocate memory from the arena free list, if
-/// possible.
+/// possible. If is_zeroed is given, it is set to whether the memory
+/// is known to read as zero.
 ///    
 void *PArena::allocFromFreeList(
-    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging)
+    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging,
+    bool *is_zeroed)
 {
 #ifdef _FORCE_FAIL
     fail_program();
@@ -202,6 +576,7 @@ void *PArena::allocFromFreeList(
                 char *mem = static_cast<char*>(mem_ci->first);
                 assert(!PMallocUtil::is_mem_allocated(mem) &&
                        "Location in free list is marked allocated!");
+                bool is_reclaimed = mem_ci->second;
 
                 void *carved_mem = nullptr;
                 if (bin_number == kMaxFreeCategory_)
@@ -235,18 +610,24 @@ void *PArena::allocFromFreeList(
                 assert(!isOnDifferentCacheLine(
                            mem, mem + sizeof(size_t)));
 
-                NVM_FLUSH(mem);
+                // Also completes the flush of the carved header
+                PMallocUtil::flush_line(mem);
+                PMallocUtil::drain_flushes();
                 
                 // If we fail here, the above allocated memory may be leaked
 
                 mem_map.erase(mem_ci);
 
+                // The body of a carved chunk lies in the body of the
+                // original one
                 if (carved_mem) insertToFreeList(
                     PMallocUtil::get_bin_number(
                         *(static_cast<size_t*>(carved_mem))),
-                    carved_mem);
+                    carved_mem, is_reclaimed);
 
                 incrementActualAllocedStats(actual_sz);
+
+                if (is_zeroed) *is_zeroed = is_reclaimed;
                 
                 return static_cast<void*>(mem +
                                           PMallocUtil::get_metadata_size());
@@ -281,6 +662,10 @@ void *PArena::allocFromUpdatedFreeList(
         size_t actual_mem_sz = PMallocUtil::get_actual_alloc_size(mem_sz);
         if (!PMallocUtil::is_mem_allocated(mem))
         {
+            // The chunk may have been freed remotely, take it off the
+            // queue before its body is reused
+            if (hasRemoteFrees()) drainRemoteFrees();
+            
             if (actual_sz > actual_mem_sz)
             {
                 // This address may be in the free list already. But the
@@ -315,7 +700,9 @@ void *PArena::allocFromUpdatedFreeList(
             assert(!isOnDifferentCacheLine(
                        mem, mem + sizeof(size_t)));
 
-            NVM_FLUSH(mem);
+            // Also completes the flush of the carved header
+            PMallocUtil::flush_line(mem);
+            PMallocUtil::drain_flushes();
 
             // If we fail here, the above allocated memory may be leaked
             deleteFromFreeList(PMallocUtil::get_bin_number(mem_sz), mem);
@@ -362,24 +749,61 @@ void *PArena::allocRawMem(size_t sz)
                CurrAllocAddr_,
                static_cast<char*>(CurrAllocAddr_) + sizeof(size_t)));
 
-    NVM_FLUSH(CurrAllocAddr_);
+    PMallocUtil::flush_line(CurrAllocAddr_);
     
     // If a crash happens here, the memory appears allocated but it is not
     // assigned to any program-visible entity, hence it is essentially lost.
     
     CurrAllocAddr_ = static_cast<void*>(
         static_cast<char*>(CurrAllocAddr_) + alloc_sz);
-    NVM_FLUSH(&CurrAllocAddr_);
+    PMallocUtil::flush_line(&CurrAllocAddr_);
+    PMallocUtil::drain_flushes();
 
     incrementActualAllocedStats(alloc_sz);
     
     return ret;
 }
 
+///
+/// Flush the headers of the chunks given in address order, each
+/// cache line once. No fence is issued, the caller must complete the
+/// flushes with drain_flushes.
+///    
+void PArena::flushChunkHeaders(void *const *ptrs, size_t n)
+{
+#if !defined(DISABLE_FLUSHES)
+    uintptr_t last_line = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uintptr_t line = reinterpret_cast<uintptr_t>(
+            PMallocUtil::ptr2mem(ptrs[i])) &
+            PMallocUtil::get_cache_line_mask();
+        if (line == last_line) continue;
+        PMallocUtil::flush_line(reinterpret_cast<void*>(line));
+        last_line = line;
+    }
+#endif
+}
+
+///
+/// Clear a range of a free chunk and flush it. No fence is issued.
+///    
+void PArena::clearRange(char *start, size_t sz)
+{
+    if (!sz) return;
+    memset(start, 0, sz);
+#if !defined(DISABLE_FLUSHES)
+    uintptr_t line = reinterpret_cast<uintptr_t>(start) &
+        PMallocUtil::get_cache_line_mask();
+    for (; line < reinterpret_cast<uintptr_t>(start + sz);
+         line += PMallocUtil::get_cache_line_size())
+        PMallocUtil::flush_line(reinterpret_cast<void*>(line));
+#endif
+}
+
 ///
 /// Add the specified chunk to a particular bin of the arena freelist
 ///    
-void PArena::insertToFreeList(uint32_t bin_no, void *mem)
+void PArena::insertToFreeList(uint32_t bin_no, void *mem, bool is_reclaimed)
 {
 #ifdef _FORCE_FAIL
     fail_program();
@@ -387,10 +811,10 @@ void PArena::insertToFreeList(uint32_t bin_no, void *mem)
     FreeList::iterator ci = FreeList_->find(bin_no);
     if (ci == FreeList_->end()) {
         MemMap mem_map;
-        mem_map.insert(std::make_pair(mem, true));
+        mem_map.insert(std::make_pair(mem, is_reclaimed));
         FreeList_->insert(std::make_pair(bin_no, mem_map));
     }
-    else ci->second.insert(std::make_pair(mem, true));
+    else ci->second.insert(std::make_pair(mem, is_reclaimed));
 }
 
 ///
@@ -435,9 +859,156 @@ void *PArena::carveExtraMem(
     assert(!isOnDifferentCacheLine(
                carved_mem, static_cast<char*>(carved_mem) + sizeof(size_t)));
 
-    NVM_FLUSH(carved_mem);
+    // Ordered before the resize of the chunk that follows, which
+    // completes the flush
+    PMallocUtil::flush_line(carved_mem);
     
     return carved_mem;
 }
 
+///
+/// Try to resize an allocated chunk without moving it. A chunk can
+/// shrink by splitting off its tail as a free chunk. It can grow into
+/// the free chunk following it or, if it is the last chunk of the
+/// arena, into the space beyond the bump pointer. Memory handed to or
+/// taken from the free list is logged as a free or an allocation, so
+/// that the consistent state orders this FASE with the ones that
+/// reuse or released it. The arena lock must be held. Returns false
+/// if the chunk cannot be resized in place.
+///    
+bool PArena::reallocInPlace(void *ptr, size_t sz, bool does_need_logging)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    assert(PMallocUtil::is_ptr_allocated(ptr) &&
+           "realloc called on unallocated memory");
+    
+    char *mem = static_cast<char*>(PMallocUtil::ptr2mem(ptr));
+    size_t actual_sz = PMallocUtil::get_actual_alloc_size(
+        PMallocUtil::get_requested_alloc_size_from_mem(mem));
+    size_t new_actual_sz = PMallocUtil::get_actual_alloc_size(sz);
+    char *end = mem + actual_sz;
+
+    if (new_actual_sz <= actual_sz) {
+        void *carved_mem = nullptr;
+        if (new_actual_sz < actual_sz)
+            carved_mem = carveLoggedTail(
+                mem, new_actual_sz, actual_sz, does_need_logging);
+        // If we fail here, the tail header is inside the allocated
+        // chunk and hence not visible
+        
+        resizeChunk(mem, sz, does_need_logging);
+
+        if (carved_mem) {
+            insertToFreeList(
+                PMallocUtil::get_bin_number(
+                    *(static_cast<size_t*>(carved_mem))),
+                carved_mem);
+            decrementActualAllocedStats(actual_sz - new_actual_sz);
+        }
+        return true;
+    }
+
+    if (end == CurrAllocAddr_) {
+        if (mem + new_actual_sz > static_cast<char*>(EndAddr_))
+            return false;
+
+        // Cover the growth with a free chunk before moving the bump
+        // pointer, so that a failure before the resize leaves the
+        // arena walkable
+        carveExtraMem(mem, actual_sz, new_actual_sz);
+        CurrAllocAddr_ = static_cast<void*>(mem + new_actual_sz);
+        PMallocUtil::flush_line(&CurrAllocAddr_);
+        PMallocUtil::drain_flushes();
+
+        // If we fail here, the growth is left behind as a free chunk
+        
+        resizeChunk(mem, sz, does_need_logging);
+        
+        incrementActualAllocedStats(new_actual_sz - actual_sz);
+        return true;
+    }
+
+    if (end < static_cast<char*>(CurrAllocAddr_) &&
+        !PMallocUtil::is_mem_allocated(end)) {
+        // The next chunk may have been freed remotely. Now that it is
+        // seen free, draining guarantees that no queued reference to
+        // its header survives the merge below.
+        if (hasRemoteFrees()) drainRemoteFrees();
+
+        size_t next_sz = PMallocUtil::get_requested_alloc_size_from_mem(end);
+        size_t merged_sz = actual_sz +
+            PMallocUtil::get_actual_alloc_size(next_sz);
+        if (merged_sz < new_actual_sz) return false;
+
+        // Taking over the next chunk is an allocation of it. Undoing
+        // it marks the chunk free again.
+#ifndef _DISABLE_ALLOC_LOGGING
+        if (does_need_logging) nvm_log_alloc(end + sizeof(size_t));
+#endif
+        void *carved_mem = nullptr;
+        if (merged_sz > new_actual_sz)
+            carved_mem = carveLoggedTail(
+                mem, new_actual_sz, merged_sz, does_need_logging);
+
+        // If we fail here, the carving does not take effect
+
+        resizeChunk(mem, sz, does_need_logging);
+
+        deleteFromFreeList(PMallocUtil::get_bin_number(next_sz), end);
+        if (carved_mem) insertToFreeList(
+            PMallocUtil::get_bin_number(
+                *(static_cast<size_t*>(carved_mem))),
+            carved_mem);
+
+        incrementActualAllocedStats(new_actual_sz - actual_sz);
+        return true;
+    }
+    return false;
+}
+
+///
+/// Split the part of a chunk past the given actual size off as a free
+/// chunk, to be put on the free list once the chunk is resized. Its
+/// header overwrites bytes that must come back if the resize is
+/// undone, and its reuse must not commit ahead of the resize, so both
+/// are logged.
+///    
+void *PArena::carveLoggedTail(char *mem, size_t actual_alloc_sz,
+                              size_t actual_sz, bool does_need_logging)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging) nvm_memcpy(
+        mem + actual_alloc_sz, PMallocUtil::get_metadata_size());
+#endif
+    char *carved_mem = static_cast<char*>(
+        carveExtraMem(mem, actual_alloc_sz, actual_sz));
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging && nvm_log_free(carved_mem + sizeof(size_t)))
+        notePendingFree(carved_mem);
+#endif
+    return carved_mem;
+}
+
+///
+/// Update the requested size of an allocated chunk. Undoing it makes
+/// the chunk boundary revert to the old one, where the header
+/// following it is restored by the logs of the resize.
+///    
+void PArena::resizeChunk(char *mem, size_t sz, bool does_need_logging)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (does_need_logging) nvm_store(mem, sizeof(size_t)*8);
+#endif
+    *(reinterpret_cast<size_t*>(mem)) = sz;
+    NVM_FLUSH(mem);
+}
+
 } // namespace Atlas
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+
+
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <new>
+#include <vector>
+
+#include <unistd.h>
+#include <sched.h>
+
+#include "ppool.hpp"
+#include "pregion.hpp"
+#include "pmalloc_util.hpp"
+#include "internal_api.h"
+#include "atlas_api.h"
+
+namespace Atlas {
+
+// Logically transient cache of objects reserved by a thread for a pool
+struct PPoolMagazine {
+    std::vector<void*> Objs_;
+    PPoolSlab *Cursor_ = nullptr; // where the next refill starts
+};
+
+// The magazines of a thread. Reserved objects go back to their pools
+// when the thread exits, unless the region is closed by then.
+class PPoolMagazines {
+public:
+    ~PPoolMagazines();
+    PPoolMagazine *get(PPool *pool);
+private:
+    std::map<PPool*, PPoolMagazine> Mags_;
+    PPool *LastPool_ = nullptr;
+    PPoolMagazine *LastMag_ = nullptr;
+};
+
+static thread_local PPoolMagazines TL_Magazines_;
+
+PPoolMagazines::~PPoolMagazines()
+{
+    for (auto & mag : Mags_)
+        if (!mag.second.Objs_.empty() &&
+            NVM_IsInOpenPR(mag.first, sizeof(PPool)))
+            mag.first->releaseObjs(
+                mag.second.Objs_.data(), mag.second.Objs_.size());
+}
+
+PPoolMagazine *PPoolMagazines::get(PPool *pool)
+{
+    if (pool != LastPool_) {
+        LastPool_ = pool;
+        LastMag_ = &Mags_[pool];
+    }
+    return LastMag_;
+}
+
+// Unique to this process, never 0
+static uint64_t get_process_epoch()
+{
+    static const uint64_t epoch = [] {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return ((static_cast<uint64_t>(getpid()) << 40) ^
+                (static_cast<uint64_t>(ts.tv_sec) * 1000000000 +
+                 ts.tv_nsec)) | 1;
+    }();
+    return epoch;
+}
+
+PPool::PPool(region_id_t rid, size_t obj_size, size_t align)
+    : RegionId_{rid}, NumObjs_{0}, Stride_{0}, ObjOffset_{0},
+      Slabs_{nullptr}, Epoch_{get_process_epoch()}
+{
+    if (!align) align = sizeof(void*);
+    assert(!(align & (align - 1)) && align <= kPageSize_ &&
+           "Pool alignment must be a power of 2 no larger than a page!");
+    if (!obj_size) obj_size = 1;
+    Stride_ = (obj_size + align - 1) & ~(align - 1);
+
+    // Find the largest number of objects that fit in a slab along
+    // with their state bytes
+    uint64_t n = (kPoolSlabSize_ - sizeof(PPoolSlab)) / (Stride_ + 1);
+    while (n && ((sizeof(PPoolSlab) + n + align - 1) & ~(align - 1)) +
+           n * Stride_ > kPoolSlabSize_) --n;
+    assert(n && "Pool objects must be much smaller than a slab!");
+    NumObjs_ = n;
+    ObjOffset_ = (sizeof(PPoolSlab) + n + align - 1) & ~(align - 1);
+
+    flushRange(this, sizeof(PPool));
+}
+
+///
+/// Allocate an object from the magazine of this thread, refilling it
+/// from the slabs of the pool if empty
+///
+void *PPool::allocMem(PRegion *rgn)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    ensureEpoch();
+    PPoolMagazine *mag = TL_Magazines_.get(this);
+    if (mag->Objs_.empty()) refill(mag, rgn);
+
+    void *ptr = mag->Objs_.back();
+    mag->Objs_.pop_back();
+
+    uint8_t *state = get_state(ptr);
+    assert(*state == kReserved_);
+
+#ifndef _DISABLE_ALLOC_LOGGING
+    nvm_log_pool_alloc(state);
+#endif
+
+    *state = kAllocated_;
+    PMallocUtil::flush_line(state);
+    PMallocUtil::drain_flushes();
+    return ptr;
+}
+
+///
+/// Free an object. It stays reserved for this thread if its magazine
+/// has room, which no other thread can observe.
+///
+void PPool::freeMem(void *ptr)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    ensureEpoch();
+    uint8_t *state = get_state(ptr);
+    assert(*state == kAllocated_ && "free called on unallocated memory");
+
+#ifndef _DISABLE_ALLOC_LOGGING
+    nvm_log_pool_free(state);
+#endif
+
+    PPoolMagazine *mag = TL_Magazines_.get(this);
+    if (mag->Objs_.size() < kPoolMagazineSize_) {
+        *state = kReserved_;
+        mag->Objs_.push_back(ptr);
+    }
+    else __atomic_store_n(state, kFree_, __ATOMIC_RELEASE);
+    PMallocUtil::flush_line(state);
+    PMallocUtil::drain_flushes();
+}
+
+///
+/// Make reserved objects available to all threads again
+///
+void PPool::releaseObjs(void *const *ptrs, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t *state = get_state(ptrs[i]);
+        assert(*state == kReserved_);
+        __atomic_store_n(state, kFree_, __ATOMIC_RELEASE);
+    }
+    // Not flushed: a reserved object is free for a later process too
+}
+
+///
+/// The first thread to use the pool in this process releases the
+/// objects reserved by threads of earlier processes. Others wait.
+///
+void PPool::ensureEpoch()
+{
+    uint64_t curr = get_process_epoch();
+    uint64_t epoch = Epoch_.load(std::memory_order_acquire);
+    if (epoch == curr) return;
+
+    // An epoch of ~curr marks a release in progress in this process.
+    // A stale marker left behind by a crash is claimed like any
+    // other epoch.
+    if (epoch != ~curr &&
+        Epoch_.compare_exchange_strong(epoch, ~curr,
+                                       std::memory_order_acq_rel)) {
+        for (PPoolSlab *slab = Slabs_.load(std::memory_order_acquire);
+             slab; slab = slab->Next_) {
+            uint8_t *states = slab->get_states();
+            for (uint32_t i = 0; i < NumObjs_; ++i)
+                if (states[i] == kReserved_) states[i] = kFree_;
+        }
+        Epoch_.store(curr, std::memory_order_release);
+        return;
+    }
+    while (Epoch_.load(std::memory_order_acquire) != curr) sched_yield();
+}
+
+///
+/// Add a slab to the pool. Slabs are extents aligned to their size
+/// and are never returned to the region.
+///
+PPoolSlab *PPool::allocSlab(PRegion *rgn)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    // Not logged: if we fail before the slab is linked in below, it
+    // is leaked but the pool is consistent
+    bool is_zeroed;
+    void *mem = rgn->getExtentArena()->allocMem(
+        kPoolSlabSize_, false, kPoolSlabSize_, &is_zeroed);
+    assert(mem && "Out of memory in this persistent region!");
+
+    PPoolSlab *slab = new (mem) PPoolSlab;
+    slab->Pool_ = this;
+    // The states of a zeroed slab already read as free
+    if (is_zeroed) {
+        NVM_FLUSH(&slab->Pool_);
+    }
+    else {
+        memset(slab->get_states(), kFree_, NumObjs_);
+        flushRange(slab, sizeof(PPoolSlab) + NumObjs_);
+    }
+
+    PPoolSlab *head = Slabs_.load(std::memory_order_acquire);
+    do {
+        slab->Next_ = head;
+        NVM_FLUSH(&slab->Next_);
+    } while (!Slabs_.compare_exchange_weak(head, slab,
+                                           std::memory_order_acq_rel));
+    NVM_FLUSH(&Slabs_);
+    return slab;
+}
+
+///
+/// Reserve up to num_wanted free objects of a slab for a magazine.
+/// Other threads may race for the same objects.
+///
+void PPool::reserveObjs(
+    PPoolSlab *slab, PPoolMagazine *mag, uint32_t num_wanted)
+{
+    uint8_t *states = slab->get_states();
+    uint32_t i = 0;
+    while (mag->Objs_.size() < num_wanted) {
+        uint8_t *free_state = static_cast<uint8_t*>(
+            memchr(states + i, kFree_, NumObjs_ - i));
+        if (!free_state) break;
+        i = free_state - states + 1;
+        uint8_t expected = kFree_;
+        if (__atomic_compare_exchange_n(
+                free_state, &expected, kReserved_, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            mag->Objs_.push_back(get_obj(slab, i - 1));
+    }
+}
+
+///
+/// Refill an empty magazine, visiting every slab at most once
+/// starting where the last refill stopped. A new slab is added only
+/// if no free object is found.
+///
+void PPool::refill(PPoolMagazine *mag, PRegion *rgn)
+{
+    const uint32_t num_wanted = kPoolMagazineSize_ / 2;
+    PPoolSlab *head = Slabs_.load(std::memory_order_acquire);
+    PPoolSlab *first = mag->Cursor_ ? mag->Cursor_ : head;
+    PPoolSlab *slab = first;
+    while (slab) {
+        reserveObjs(slab, mag, num_wanted);
+        if (mag->Objs_.size() == num_wanted) break;
+        slab = slab->Next_ ? slab->Next_ : head;
+        if (slab == first) break;
+    }
+    if (mag->Objs_.empty()) {
+        slab = allocSlab(rgn);
+        reserveObjs(slab, mag, num_wanted);
+        assert(!mag->Objs_.empty());
+    }
+    mag->Cursor_ = slab;
+}
+
+void PPool::flushRange(void *addr, size_t sz)
+{
+    uintptr_t mask = PMallocUtil::get_cache_line_mask();
+    uintptr_t last = (reinterpret_cast<uintptr_t>(addr) + sz - 1) & mask;
+    for (uintptr_t line = reinterpret_cast<uintptr_t>(addr) & mask;
+         line <= last; line += kDCacheLineSize_)
+        PMallocUtil::flush_line(reinterpret_cast<void*>(line));
+    PMallocUtil::drain_flushes();
+}
+
+} // namespace Atlas
@@ -17,30 +17,42 @@
  
 
 #include <cassert>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 
 #include "pregion.hpp"
 
 namespace Atlas {
 
 ///
-/// Entry point for region-based allocation
+/// Entry point for region-based allocation. If is_zeroed is given, it
+/// is set to whether the memory is known to read as zero.
 ///    
 void *PRegion::allocMem(
-    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging)
+    size_t sz, bool does_need_cache_line_alignment, bool does_need_logging,
+    bool *is_zeroed)
 {
     assert(!IsDeleted_ && "Attempt to allocate memory from deleted region!");
     assert(IsMapped_ && "Attempt to allocate memory from unmapped region!");
 
-    // adjust current arena if required
-    if (!PMallocUtil::is_valid_tl_curr_arena(Id_))
-        PMallocUtil::set_tl_curr_arena(
-            Id_, (uint64_t)pthread_self() % kNumArenas_);
-
     void *alloc_ptr = nullptr;
+    if (is_zeroed) *is_zeroed = false;
+    // Fall back to the arenas if the extents are exhausted
+    if (sz >= kExtentThreshold_ &&
+        (alloc_ptr = ExtentArena_.allocMem(
+            sz, does_need_logging, 0, is_zeroed)))
+        return alloc_ptr;
+    
+    adjustTLCurrArena();
+
     bool should_update_free_list = false;
     if ((alloc_ptr = allocMemFromArenas(
              sz, should_update_free_list,
-             does_need_cache_line_alignment, does_need_logging))) {
+             does_need_cache_line_alignment, does_need_logging,
+             is_zeroed))) {
         assert(doesRangeCheck(alloc_ptr,
                               PMallocUtil::get_actual_alloc_size(sz)) &&
                "Attempt to allocate memory outside the requested region!");
@@ -52,7 +64,8 @@ void *PRegion::allocMem(
     should_update_free_list = true;
     if ((alloc_ptr = allocMemFromArenas(
              sz, should_update_free_list,
-             does_need_cache_line_alignment, does_need_logging))) {
+             does_need_cache_line_alignment, does_need_logging,
+             is_zeroed))) {
         assert(doesRangeCheck(alloc_ptr,
                               PMallocUtil::get_actual_alloc_size(sz)) &&
                "Attempt to allocate memory outside the requested region!");
@@ -69,21 +82,72 @@ void *PRegion::allocMem(
     return nullptr;
 }
 
+///
+/// Entry point for region-based batch allocation. Runs of chunks
+/// are carved from the bump pointer of as few arenas as possible;
+/// whatever does not fit goes through the regular path.
+///    
+void PRegion::allocMemBatch(
+    const size_t *sizes, size_t n, void **out, bool does_need_logging)
+{
+    assert(!IsDeleted_ && "Attempt to allocate memory from deleted region!");
+    assert(IsMapped_ && "Attempt to allocate memory from unmapped region!");
+
+    adjustTLCurrArena();
+
+    size_t done = 0;
+    uint32_t arena_count = 0;
+    bool does_need_cache_line_alignment = false;
+    while (done < n && arena_count < NumArenas_) {
+        // Large objects go to the extents one at a time
+        if (sizes[done] >= kExtentThreshold_) {
+            out[done] = allocMem(
+                sizes[done], does_need_cache_line_alignment,
+                does_need_logging);
+            ++done;
+            continue;
+        }
+        size_t run = 1;
+        while (done + run < n && sizes[done + run] < kExtentThreshold_)
+            ++run;
+        
+        PArena *parena = getArena(PMallocUtil::get_tl_curr_arena(Id_));
+        parena->Lock();
+        if (parena->hasRemoteFrees()) parena->drainRemoteFrees();
+        size_t count = parena->allocMemBatch(
+            sizes + done, run, out + done, does_need_logging);
+        parena->Unlock();
+        done += count;
+        if (count == run) continue;
+
+        ++arena_count;
+        
+        // round robin if the current arena is full
+        PMallocUtil::set_tl_curr_arena(
+            Id_, PMallocUtil::get_tl_next_arena(Id_, NumArenas_));
+    }
+
+    for (; done < n; ++done)
+        out[done] = allocMem(
+            sizes[done], does_need_cache_line_alignment, does_need_logging);
+}
+
 ///
 /// Traverse the arenas, try to allocate available memory from an
 /// unlocked one, otherwise use the free list
 ///    
 void *PRegion::allocMemFromArenas(
     size_t sz, bool should_update_free_list,
-    bool does_need_cache_line_alignment, bool does_need_logging)
+    bool does_need_cache_line_alignment, bool does_need_logging,
+    bool *is_zeroed)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    assert(PMallocUtil::get_tl_curr_arena(Id_) < kNumArenas_ &&
+    assert(PMallocUtil::get_tl_curr_arena(Id_) < NumArenas_ &&
            "Arena index is out of range!");
     
-    bool arena_tracker[kNumArenas_];
+    bool arena_tracker[kMaxNumArenas_];
     memset(arena_tracker, 0, sizeof(arena_tracker));
     
     // Start with the arena used the last time, reducing false sharing
@@ -92,7 +156,7 @@ void *PRegion::allocMemFromArenas(
         // look inside an arena only once
         if (arena_tracker[PMallocUtil::get_tl_curr_arena(Id_)]) {
             PMallocUtil::set_tl_curr_arena(
-                Id_, PMallocUtil::get_tl_next_arena(Id_));
+                Id_, PMallocUtil::get_tl_next_arena(Id_, NumArenas_));
             continue;
         }
         
@@ -102,20 +166,24 @@ void *PRegion::allocMemFromArenas(
         while ((status = parena->tryLock())) {
             assert(status == EBUSY && "Trylock returned unexpected status!");
             PMallocUtil::set_tl_curr_arena(
-                Id_, PMallocUtil::get_tl_next_arena(Id_));
+                Id_, PMallocUtil::get_tl_next_arena(Id_, NumArenas_));
             parena = getArena(PMallocUtil::get_tl_curr_arena(Id_));
         }
         arena_tracker[PMallocUtil::get_tl_curr_arena(Id_)] = true;
 
+        if (parena->hasRemoteFrees()) parena->drainRemoteFrees();
+
         void *alloc_ptr = nullptr;
         if (!should_update_free_list) {
             if ((alloc_ptr = parena->allocMem(
-                     sz, does_need_cache_line_alignment, does_need_logging))) {
+                     sz, does_need_cache_line_alignment, does_need_logging,
+                     is_zeroed))) {
                 parena->Unlock();
                 return alloc_ptr;
             }
             if ((alloc_ptr = parena->allocFromFreeList(
-                     sz, does_need_cache_line_alignment, does_need_logging))) {
+                     sz, does_need_cache_line_alignment, does_need_logging,
+                     is_zeroed))) {
                 parena->Unlock();
                 return alloc_ptr;
             }
@@ -133,8 +201,8 @@ void *PRegion::allocMemFromArenas(
 
         // round robin if the current arena is full
         PMallocUtil::set_tl_curr_arena(
-            Id_, PMallocUtil::get_tl_next_arena(Id_));
-    }while (arena_count < kNumArenas_);
+            Id_, PMallocUtil::get_tl_next_arena(Id_, NumArenas_));
+    }while (arena_count < NumArenas_);
 
     return nullptr;
 }
@@ -146,9 +214,12 @@ void *PRegion::callocMem(size_t nmemb, size_t sz)
 {
     bool does_need_cache_line_alignment = false;
     bool does_need_logging = true;
+    bool is_zeroed;
     void *calloc_mem = allocMem(nmemb * sz, does_need_cache_line_alignment,
-                                does_need_logging);
-    memset(calloc_mem, 0, nmemb * sz);
+                                does_need_logging, &is_zeroed);
+    // Memory never handed out since the region file was created or
+    // since its pages were returned to the OS needs no clearing
+    if (!is_zeroed) PMallocUtil::zero_mem(calloc_mem, nmemb * sz);
     return calloc_mem;
 }
 
@@ -165,7 +236,18 @@ void *PRegion::reallocMem(void *ptr, size_t sz)
         freeMem(ptr, does_need_logging);
         return nullptr;
     }
-    size_t curr_sz = PMallocUtil::get_requested_alloc_size_from_ptr(ptr);
+    if (isExtent(ptr)) {
+        if (ExtentArena_.reallocInPlace(ptr, sz, does_need_logging))
+            return ptr;
+    }
+    else if (doesRangeCheck(ptr, 0)) {
+        PArena *parena = getArena(getArenaIndex(ptr));
+        parena->Lock();
+        bool is_resized = parena->reallocInPlace(ptr, sz, does_need_logging);
+        parena->Unlock();
+        if (is_resized) return ptr;
+    }
+    size_t curr_sz = getAllocSize(ptr);
     void *realloced_ptr = allocMem(sz, does_need_cache_line_alignment,
                                    does_need_logging);
     memcpy(realloced_ptr, ptr, curr_sz < sz ? curr_sz : sz);
@@ -173,6 +255,117 @@ void *PRegion::reallocMem(void *ptr, size_t sz)
     return realloced_ptr;
 }
 
+///
+/// Set the memory policy of every arena so that its pages are
+/// preferably allocated on the NUMA node the arena is assigned to
+///    
+void PRegion::bindArenasToNumaNodes()
+{
+#if defined(_ARENA_NUMA)
+    uint32_t num_nodes = PMallocUtil::get_num_numa_nodes();
+    if (num_nodes < 2) return;
+    for (uint32_t i = 0; i < NumArenas_; ++i) {
+        unsigned long nodemask =
+            1UL << PMallocUtil::get_numa_node_of_arena(i, NumArenas_);
+        // Not fatal: the policy is only a placement hint
+        if (syscall(SYS_mbind, Arena_[i].get_start_addr(), ArenaSize_,
+                    MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0))
+            perror("mbind");
+    }
+#endif
+}
+
+///
+/// Return the free memory of the arenas to the OS, see
+/// PArena::reclaimFreeMem. Arenas never used in this mapping have
+/// nothing to return. Returns the number of bytes returned.
+///
+size_t PRegion::reclaimFreeMem()
+{
+    size_t punch_align = std::max(ExtentArena_.get_punch_align(), kPageSize_);
+    size_t reclaimed = 0;
+    for (uint32_t i = 0; i < NumArenas_; ++i)
+        if (Arena_[i].hasTransients(ArenaEpoch_))
+            reclaimed += Arena_[i].reclaimFreeMem(
+                FileDesc_, BaseAddr_, punch_align);
+    return reclaimed;
+}
+
+///
+/// Return the whole blocks of a range of the region, whose contents
+/// are no longer needed, to the OS. Returns the number of bytes
+/// returned.
+///
+size_t PRegion::punchHole(void *addr, size_t sz)
+{
+    uintptr_t punch_align = std::max(ExtentArena_.get_punch_align(),
+                                      kPageSize_);
+    char *hole = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(addr) + punch_align - 1) &
+        ~(punch_align - 1));
+    char *hole_end = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(addr) + sz) & ~(punch_align - 1));
+    if (hole_end <= hole) return 0;
+    if (!PMallocUtil::punch_hole(
+            FileDesc_, hole - static_cast<char*>(BaseAddr_),
+            hole, hole_end - hole))
+        return 0;
+    return hole_end - hole;
+}
+
+///
+/// Append the page ranges of the region that hold allocated data, in
+/// address order. Free space is left out so that touching the ranges
+/// neither commits memory nor undoes reclaiming.
+///
+void PRegion::getPopulatedRanges(
+    std::vector<std::pair<char*, size_t> > *ranges)
+{
+    for (uint32_t i = 0; i < NumArenas_; ++i)
+        getArena(i)->getAllocatedRanges(ranges);
+    ExtentArena_.getPopulatedRanges(ranges);
+}
+
+///
+/// Append the page ranges of the region that may hold data, including
+/// extents that were freed since. The allocators must be locked.
+///
+void PRegion::getWrittenRanges(
+    std::vector<std::pair<char*, size_t> > *ranges)
+{
+    getArenaRanges(ranges);
+    ExtentArena_.getWrittenRanges(ranges);
+}
+
+///
+/// Keep the allocators of the region from changing its persistent
+/// metadata and the chunk and extent descriptors
+///
+void PRegion::lockAllocators()
+{
+    for (uint32_t i = 0; i < NumArenas_; ++i) getArena(i)->Lock();
+    ExtentArena_.Lock();
+}
+
+void PRegion::unlockAllocators()
+{
+    ExtentArena_.Unlock();
+    for (uint32_t i = 0; i < NumArenas_; ++i) Arena_[i].Unlock();
+}
+
+void PRegion::getArenaRanges(std::vector<std::pair<char*, size_t> > *ranges)
+{
+    for (uint32_t i = 0; i < NumArenas_; ++i) {
+        PArena *parena = &Arena_[i];
+        char *start = static_cast<char*>(parena->get_start_addr());
+        char *end = std::max(static_cast<char*>(parena->get_curr_alloc_addr()),
+                             static_cast<char*>(parena->get_dirty_end_addr()));
+        if (end > start)
+            ranges->push_back(std::make_pair(
+                start, (end - start + kPageSize_ - 1) & ~(kPageSize_ - 1)));
+    }
+}
+
 ///
 /// Flush out persistent metadata of a persistent region
 ///    
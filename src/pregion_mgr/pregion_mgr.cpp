@@ -22,6 +22,8 @@
 #include <cstring>
 #include <cassert>
 #include <utility>
+#include <vector>
+#include <algorithm>
 
 #include <pthread.h>
 #include <sys/file.h>
@@ -30,20 +32,32 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
 
+#include "atlas_alloc.h"
 #include "pregion_mgr.hpp"
 #include "log_mgr.hpp"
 #include "util.hpp"
 #include "fail.hpp"
 
-#ifdef _NVDIMM_PROLIANT
+#if defined(_NVDIMM_PROLIANT) || defined(_MSYNC_DURABILITY)
 #include "fsync.hpp"
 #endif
 
+// Older C libraries lack it, older kernels take it as a hint
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
 namespace Atlas {
     
 PRegionMgr *PRegionMgr::Instance_{nullptr};
 
+static_assert(sizeof(PRegionTableHeader) +
+              kMaxNumPRegions_ * sizeof(PRegion) <=
+              kPRegionTableSize_, "Region table too small!");
+
 ///
 /// Entry point for freeing a persistent location
 ///    
@@ -78,38 +92,157 @@ void PRegionMgr::deleteMem(void *ptr, bool should_log) const
 void PRegionMgr::freeMemImpl(
 region_id_t rgn_id, void *ptr, bool should_log) const
 {
+    PRegion *preg = getPRegion(rgn_id);
+
     // Now that we can find out the correct size, assert that all the
-    // bytes of the memory location indeed belong to this region
-    assert((getOpenPRegionId(
+    // bytes of the memory location indeed belong to this region. An
+    // extent never crosses regions.
+    assert((preg->isExtent(ptr) ||
+            getOpenPRegionId(
                 ptr, PMallocUtil::get_actual_alloc_size(
                     PMallocUtil::get_requested_alloc_size_from_ptr(ptr))) ==
             rgn_id) && "Location to be freed crosses regions!");
     
-    PRegion *preg = getPRegion(rgn_id);
     assert((!preg->is_deleted() && preg->is_mapped()) &&
            "Pointer to be freed belongs to a deleted or unmapped region!");
     preg->freeMem(ptr, should_log);
 }
     
+///
+/// Entry point for freeing a group of locations. A single log
+/// record covers all persistent locations and each arena involved
+/// is locked once.
+///    
+void PRegionMgr::freeMemBatch(void **ptrs, size_t n, bool should_log) const
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    std::vector<void*> pmem;
+    pmem.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        region_id_t rgn_id = getOpenPRegionId(ptrs[i], 1 /* dummy */);
+        if (rgn_id == kInvalidPRegion_) free(ptrs[i]); // transient memory
+        else if (getPRegion(rgn_id)->isExtent(ptrs[i]))
+            freeMemImpl(rgn_id, ptrs[i], should_log);
+        else pmem.push_back(ptrs[i]);
+    }
+    if (pmem.empty()) return;
+
+    // Address order groups the locations by region and arena
+    std::sort(pmem.begin(), pmem.end());
+
+    bool is_logged = false;
+#ifndef _DISABLE_ALLOC_LOGGING
+    if (should_log) {
+        std::vector<void*> is_allocated_addrs;
+        is_allocated_addrs.reserve(pmem.size());
+        for (void *ptr : pmem)
+            is_allocated_addrs.push_back(
+                static_cast<char*>(PMallocUtil::ptr2mem(ptr)) +
+                sizeof(size_t));
+        is_logged = nvm_log_free_batch(is_allocated_addrs.data(),
+                                       is_allocated_addrs.size());
+    }
+#endif
+
+    size_t first = 0;
+    while (first < pmem.size()) {
+        region_id_t rgn_id = getOpenPRegionId(pmem[first], 1 /* dummy */);
+        size_t last = first;
+        for (; last < pmem.size(); ++last) {
+            // See freeMemImpl
+            if (getOpenPRegionId(
+                    pmem[last], PMallocUtil::get_actual_alloc_size(
+                        PMallocUtil::get_requested_alloc_size_from_ptr(
+                            pmem[last]))) != rgn_id) break;
+        }
+        assert(last > first && "Location to be freed crosses regions!");
+        
+        PRegion *preg = getPRegion(rgn_id);
+        assert((!preg->is_deleted() && preg->is_mapped()) &&
+               "Pointer to be freed belongs to a deleted or unmapped region!");
+        preg->freeMemBatch(pmem.data() + first, last - first, is_logged);
+        first = last;
+    }
+}
+
+///
+/// Called by the helper thread once a logged free is committed
+///    
+void PRegionMgr::completeFree(void *is_allocated_addr) const
+{
+    region_id_t rgn_id = getOpenPRegionId(is_allocated_addr, sizeof(size_t));
+    // The region may have been closed in the meantime
+    if (rgn_id == kInvalidPRegion_) return;
+    getPRegion(rgn_id)->completeFree(is_allocated_addr);
+}
+
+///
+/// Return the free memory of the regions mapped by this process to
+/// the OS. Returns the number of bytes returned.
+///
+size_t PRegionMgr::reclaimFreeMem()
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    size_t reclaimed = 0;
+    acquireSharedTableLock();
+    for (region_id_t rid = 0; rid < getNumPRegions(); ++rid) {
+        // Keeps the region from being closed
+        acquirePRegionLock(rid);
+        PRegion *preg = getPRegion(rid);
+        if (!preg->is_deleted() && preg->is_mapped() &&
+            isPRegionMappedHere(preg))
+            reclaimed += preg->reclaimFreeMem();
+        releasePRegionLock(rid);
+    }
+    releaseTableLock();
+    return reclaimed;
+}
+
+///
+/// Return the pages of a range of an open region, whose contents are
+/// no longer needed, to the OS. Returns the number of bytes returned.
+///
+size_t PRegionMgr::punchHole(void *addr, size_t sz) const
+{
+    region_id_t rgn_id = getOpenPRegionId(addr, sz);
+    if (rgn_id == kInvalidPRegion_) return 0;
+    return getPRegion(rgn_id)->punchHole(addr, sz);
+}
+
 ///
 /// Given a persistent region name and corresponding attributes,
-/// return its id, creating it if necessary
+/// return its id, creating it with the given size if necessary
 ///    
 region_id_t PRegionMgr::findOrCreatePRegion(
-    const char *name, int flags, int *is_created)
+    const char *name, int flags, int *is_created, uint64_t size)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
     assert(name);
     assert(std::strlen(name) < kMaxlen_+1);
+    size = computePRegionSize(size);
+
+    PRegion *rgn = findExistingPRegion(name, flags);
+    if (rgn) {
+        if (is_created) *is_created = false;
+
+        tracePRegion(rgn->get_id(), kFind_);
+        statsPRegion(rgn->get_id());
+        
+        return rgn->get_id();
+    }
 
     acquireTableLock(); 
     acquireExclusiveFLock();
 
-    PRegion *rgn = searchPRegion(name);
-    if (rgn && !rgn->is_deleted()) {
-        initExistingPRegionImpl(rgn, name, flags);
+    rgn = searchPRegion(name);
+    if (rgn && !rgn->is_deleted()) { // created in the meantime
+        openExistingPRegion(rgn, name, flags);
         
         releaseFLock();
         releaseTableLock();
@@ -122,9 +255,7 @@ region_id_t PRegionMgr::findOrCreatePRegion(
         return rgn->get_id();
     }
     else if (rgn) { // previously deleted region
-        // reuse id and base_address
-        mapNewPRegionImpl(
-            rgn, name, rgn->get_id(), flags, rgn->get_base_addr());
+        rgn = reuseDeletedPRegion(rgn, name, flags, size);
 
         releaseFLock();
         releaseTableLock();
@@ -137,7 +268,7 @@ region_id_t PRegionMgr::findOrCreatePRegion(
         return rgn->get_id();
     }
     else {
-        region_id_t rgn_id = initNewPRegionImpl(name, flags);
+        region_id_t rgn_id = initNewPRegionImpl(name, flags, size);
         
         releaseFLock();
         releaseTableLock();
@@ -163,10 +294,18 @@ region_id_t PRegionMgr::findPRegion(const char *name, int flags,
     assert(name);
     assert(std::strlen(name) < kMaxlen_+1);
 
+    PRegion *rgn = findExistingPRegion(name, flags);
+    if (rgn) {
+        tracePRegion(rgn->get_id(), kFind_);
+        statsPRegion(rgn->get_id());
+
+        return rgn->get_id();
+    }
+
     acquireTableLock();
     acquireExclusiveFLock();
 
-    PRegion *rgn = searchPRegion(name);
+    rgn = searchPRegion(name);
     // If there was a failure earlier, we want to reuse the region entry
     if (!rgn || (rgn->is_deleted() && !is_in_recovery)) {
         releaseFLock();
@@ -178,13 +317,14 @@ region_id_t PRegionMgr::findPRegion(const char *name, int flags,
         // deleted region. Reuse id and base address in such a
         // case but it is ok to re-initialize the root.
         mapNewPRegionImpl(
-            rgn, name, rgn->get_id(), flags, rgn->get_base_addr());
+            rgn, name, rgn->get_id(), flags, rgn->get_base_addr(),
+            rgn->get_size());
 
         releaseFLock();
         releaseTableLock();
     }
     else {
-        initExistingPRegionImpl(rgn, name, flags);
+        openExistingPRegion(rgn, name, flags);
 
         releaseFLock();
         releaseTableLock();
@@ -197,30 +337,29 @@ region_id_t PRegionMgr::findPRegion(const char *name, int flags,
 }
 
 ///
-/// Create a new persistent region with the given name and attributes
+/// Create a new persistent region with the given name, attributes
+/// and size
 ///    
-region_id_t PRegionMgr::createPRegion(const char *name, int flags)
+region_id_t PRegionMgr::createPRegion(
+    const char *name, int flags, uint64_t size)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
     assert(name);
     assert(std::strlen(name) < kMaxlen_+1);
+    size = computePRegionSize(size);
 
     acquireTableLock();
     acquireExclusiveFLock();
 
     region_id_t rgn_id = kInvalidPRegion_;
     PRegion *rgn = searchPRegion(name);
-    if (rgn && rgn->is_deleted()) {
-        // reuse id and base address
-        mapNewPRegionImpl(
-            rgn, name, rgn->get_id(), flags, rgn->get_base_addr());
-        rgn_id = rgn->get_id();
-    }
+    if (rgn && rgn->is_deleted())
+        rgn_id = reuseDeletedPRegion(rgn, name, flags, size)->get_id();
     else if (rgn)
         assert(!rgn && "Region exists, use a different region!");
-    else rgn_id = initNewPRegionImpl(name, flags);
+    else rgn_id = initNewPRegionImpl(name, flags, size);
 
     releaseFLock();
     releaseTableLock();
@@ -233,7 +372,8 @@ region_id_t PRegionMgr::createPRegion(const char *name, int flags)
 
 ///
 /// Remove the mappings of a persistent region from memory. It cannot
-/// be subsequently used without "finding" it again.
+/// be subsequently used without "finding" it again. Unless deleting,
+/// only the lock of the region is held exclusively.
 ///    
 void PRegionMgr::closePRegion(region_id_t rid, bool is_deleting)
 {
@@ -241,8 +381,9 @@ void PRegionMgr::closePRegion(region_id_t rid, bool is_deleting)
     fail_program();
 #endif
     if (!is_deleting) {
-        acquireTableLock();
-        acquireExclusiveFLock();
+        acquireSharedTableLock();
+        acquireSharedFLock();
+        acquirePRegionLock(rid);
     }
     
     PRegion *preg = getPRegion(rid);
@@ -251,18 +392,28 @@ void PRegionMgr::closePRegion(region_id_t rid, bool is_deleting)
            "Region to be closed already deleted!");
     assert(preg->is_mapped() && "Region to be closed not mapped!");
 
-    int status = munmap(preg->get_base_addr(), kPRegionSize_);
+    stopPrefault(rid);
+#if defined(_MSYNC_DURABILITY)
+    // Pages still recorded as dirty by any thread can no longer be
+    // synced once unmapped
+    if (msync(preg->get_base_addr(), preg->get_size(), MS_SYNC))
+        perror("msync");
+#endif
+    int status = munmap(preg->get_base_addr(), preg->get_size());
     if (status) {
         perror("munmap");
         assert(!status && "munmap of user region failed!");
     }
+    deleteExtent(preg->get_base_addr(),
+                 (char*)preg->get_base_addr() + preg->get_size() - 1, rid);
     preg->set_is_mapped(false);
     close(preg->get_file_desc());
     
     preg->~PRegion();
     
     if (!is_deleting) {
-        releaseFLock();
+        releasePRegionLock(rid);
+        releaseSharedFLock();
         releaseTableLock();
     }
 
@@ -291,14 +442,15 @@ void PRegionMgr::deletePRegion(const char *name)
 
     preg->set_is_deleted(true);
 
-    if (preg->is_mapped()) {
+    // The persistent flag may be stale after a failure
+    if (preg->is_mapped() && isPRegionMappedHere(preg)) {
         bool is_deleting = true;
         closePRegion(preg->get_id(), is_deleting);
     }
 
     char *s = NVM_GetFullyQualifiedRegionName(name);
     unlink(s);
-#ifdef _NVDIMM_PROLIANT
+#if defined(_NVDIMM_PROLIANT) || defined(_MSYNC_DURABILITY)
     char *parent = strdup(s);
     fsync_dir(parent);
     free(parent);
@@ -345,7 +497,7 @@ void PRegionMgr::deleteForcefullyPRegion(PRegion *preg)
     preg->set_is_deleted(true);
     char *s = NVM_GetFullyQualifiedRegionName(preg->get_name());
     unlink(s);
-#ifdef _NVDIMM_PROLIANT
+#if defined(_NVDIMM_PROLIANT) || defined(_MSYNC_DURABILITY)
     char *parent = strdup(s);
     fsync_dir(parent);
     free(parent);
@@ -406,8 +558,8 @@ void PRegionMgr::setNumPRegions(uint32_t count)
 #endif
     assert(count >= 0 && count < kMaxNumPRegions_
            && "Maximum region count exceeded!");
-    *(static_cast<uint32_t*>(PRegionTable_)) = count;
-    NVM_FLUSH(PRegionTable_);
+    getPRegionTableHeader()->NumPRegions_ = count;
+    NVM_FLUSH(&getPRegionTableHeader()->NumPRegions_);
 }
     
 ///
@@ -430,10 +582,24 @@ void PRegionMgr::initPRegionTable()
 
     PRegionTable_ = (void *)kPRegionsBase_;
     PRegionTableFD_ = mapFile(region_table_name, O_RDWR, PRegionTable_,
-                              does_region_table_exist);
-
-    // initialize number of entries
-    if (!does_region_table_exist) setNumPRegions(0);
+                              kPRegionTableSize_, does_region_table_exist);
+
+    // A table still all zero was created by a run that failed before
+    // initializing it
+    PRegionTableHeader *header = getPRegionTableHeader();
+    if (!does_region_table_exist ||
+        (!header->Magic_ && !header->NumPRegions_)) {
+        setNumPRegions(0);
+        header->Magic_ = kPRegionTableMagic_;
+        NVM_FLUSH(&header->Magic_);
+    }
+    else if (header->Magic_ != kPRegionTableMagic_) {
+        fprintf(stderr, "[Atlas] Region table %s has an unknown layout, "
+                "it was written by another version of Atlas. Remove it "
+                "along with the regions to start over.\n",
+                region_table_name);
+        exit(EXIT_FAILURE);
+    }
 
     free(region_table_name);
 }
@@ -446,7 +612,10 @@ void PRegionMgr::shutPRegionTable()
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    int status = munmap(PRegionTable_, kPRegionSize_);
+    // Regions left open are still being prefaulted
+    while (!Prefaults_.empty()) stopPrefault(Prefaults_.begin()->first);
+
+    int status = munmap(PRegionTable_, kPRegionTableSize_);
     if (status) {
         perror("munmap");
         assert(!status && "munmap failed!");
@@ -458,18 +627,22 @@ void PRegionMgr::shutPRegionTable()
 /// address space and insert the available address range into the
 /// region manager metadata
 ///    
-region_id_t PRegionMgr::initNewPRegionImpl(const char *name, int flags)
+region_id_t PRegionMgr::initNewPRegionImpl(
+    const char *name, int flags, uint64_t size)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
     void *base_addr = computeNewPRegionBaseAddr();
-    region_id_t rgn_id = mapNewPRegion(name, flags, base_addr);
+    assert(static_cast<char*>(base_addr) + size <=
+           (char*)kPRegionsBase_ + kPRegionTableSize_ + kPRegionsVASize_ &&
+           "Address space for persistent regions exhausted!");
+    region_id_t rgn_id = mapNewPRegion(name, flags, base_addr, size);
     return rgn_id;
 }
     
 region_id_t PRegionMgr::mapNewPRegion(
-    const char *name, int flags, void *base_addr)
+    const char *name, int flags, void *base_addr, uint64_t size)
 {
 #ifdef _FORCE_FAIL
     fail_program();
@@ -477,7 +650,7 @@ region_id_t PRegionMgr::mapNewPRegion(
     uint32_t num_entries = getNumPRegions();
     PRegion *rgn = instantiateNewPRegion(num_entries);
 
-    mapNewPRegionImpl(rgn, name, num_entries, flags, base_addr);
+    mapNewPRegionImpl(rgn, name, num_entries, flags, base_addr, size);
 
     // Incrementing the number of regions commits the region
     // metadata. If there is a failure before this increment, none of
@@ -487,32 +660,91 @@ region_id_t PRegionMgr::mapNewPRegion(
     return num_entries;
 }
 
+///
+/// Recreate a previously deleted region. Its id and base address are
+/// reused if the new region fits in the old address range, in which
+/// case it keeps the old size. Otherwise the entry is retired and a
+/// new one is made.
+///
+PRegion *PRegionMgr::reuseDeletedPRegion(
+    PRegion *rgn, const char *name, int flags, uint64_t size)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    if (size <= rgn->get_size()) {
+        mapNewPRegionImpl(rgn, name, rgn->get_id(), flags,
+                          rgn->get_base_addr(), rgn->get_size());
+        return rgn;
+    }
+    rgn->retire();
+    return getPRegion(initNewPRegionImpl(name, flags, size));
+}
+
 // TODO: bug fix: this routine is not failure-atomic. The fix is to
 // change the region ctor to set the deleted bit to true. Then once
 // all the changes below are done, set the deleted bit to
 // false. 
 void PRegionMgr::mapNewPRegionImpl(
     PRegion *rgn, const char *name, region_id_t rid,
-    int flags, void *base_addr)
+    int flags, void *base_addr, uint64_t size)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
     assert(rgn && "To-be-mapped region not found!");
 
-    new (rgn) PRegion(name, rid, base_addr);
+    new (rgn) PRegion(name, rid, base_addr, size);
     bool does_exist = false;
     char *fully_qualified_name = NVM_GetFullyQualifiedRegionName(name);
     rgn->set_file_desc(
-        mapFile(fully_qualified_name, flags, base_addr, does_exist));
+        mapFile(fully_qualified_name, flags, base_addr, size, does_exist));
+    rgn->initExtentTransients();
 
-    insertExtent(base_addr, (char*)base_addr + kPRegionSize_ - 1, rid);
+    rgn->bindArenasToNumaNodes();
+    startPrefault(rgn, flags);
+
+    insertExtent(base_addr, (char*)base_addr + size - 1, rid);
     
     free(fully_qualified_name);
     
     initPRegionRoot(rgn);
 }
     
+///
+/// Find a region that exists and is not deleted, holding the table
+/// locks in shared mode, and map it unless this process has it mapped
+/// already. Returns null if the region is to be created or recreated.
+///
+PRegion *PRegionMgr::findExistingPRegion(const char *name, int flags)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    acquireSharedTableLock();
+    acquireSharedFLock();
+
+    PRegion *rgn = searchPRegion(name);
+    if (rgn && !rgn->is_deleted()) openExistingPRegion(rgn, name, flags);
+    else rgn = nullptr;
+
+    releaseSharedFLock();
+    releaseTableLock();
+    return rgn;
+}
+
+void PRegionMgr::openExistingPRegion(
+    PRegion *preg, const char *name, int flags)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    acquirePRegionLock(preg->get_id());
+    if (!isPRegionMappedHere(preg))
+        initExistingPRegionImpl(preg, name, flags);
+    releasePRegionLock(preg->get_id());
+}
+
 void PRegionMgr::initExistingPRegionImpl(
     PRegion *preg, const char *name, int flags)
 {
@@ -537,11 +769,15 @@ void PRegionMgr::mapExistingPRegion(PRegion *preg, const char *name, int flags)
     bool does_exist = true;
 
     char *fully_qualified_name = NVM_GetFullyQualifiedRegionName(name);
-    preg->set_file_desc(mapFile(fully_qualified_name,
-                                flags, preg->get_base_addr(), does_exist));
+    preg->set_file_desc(mapFile(fully_qualified_name, flags,
+                                preg->get_base_addr(), preg->get_size(),
+                                does_exist));
+    preg->initExtentTransients();
+    preg->bindArenasToNumaNodes();
+    startPrefault(preg, flags);
 
     insertExtent(preg->get_base_addr(),
-                 (char*)preg->get_base_addr() + kPRegionSize_ - 1,
+                 (char*)preg->get_base_addr() + preg->get_size() - 1,
                  preg->get_id());
     
     free(fully_qualified_name);
@@ -550,11 +786,14 @@ void PRegionMgr::mapExistingPRegion(PRegion *preg, const char *name, int flags)
 }
 
 int PRegionMgr::mapFile(
-    const char *name, int flags, void *base_addr, bool does_exist)
+    const char *name, int flags, void *base_addr, uint64_t size,
+    bool does_exist)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
+    bool does_want_huge_pages = flags & NVM_REGION_HUGEPAGE;
+    flags &= ~(NVM_REGION_HUGEPAGE | NVM_REGION_PREFAULT);
     int fd = open(
         name, does_exist ? flags : flags |
 #ifdef _NVDIMM_PROLIANT
@@ -568,38 +807,135 @@ int PRegionMgr::mapFile(
     }
 
     if (!does_exist) {
-        int status = ftruncate(fd, kPRegionSize_);
+        int status = ftruncate(fd, size);
         assert(!status);
     }
 
-    void *addr = mmap(base_addr, kPRegionSize_,
+    // A file on hugetlbfs is always backed by huge pages, elsewhere
+    // they can only be asked for
+    struct statfs fs_buffer;
+    bool is_on_hugetlbfs = does_want_huge_pages &&
+        !fstatfs(fd, &fs_buffer) && fs_buffer.f_type == HUGETLBFS_MAGIC;
+
+    // A mere hint is not honored for files whose file system pads the
+    // search for a huge page aligned address, and regions are laid out
+    // back to back
+    void *addr = mmap(base_addr, size,
                        flags == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE,
-                       MAP_SHARED, fd, 0);
+                       MAP_SHARED | MAP_FIXED_NOREPLACE |
+                       (is_on_hugetlbfs ? MAP_HUGETLB : 0),
+                       fd, 0);
     if (addr == MAP_FAILED) {
         perror("mmap");
         assert(addr != MAP_FAILED && "mmap failed!");
     }
     assert(addr == base_addr && "mmap returned address is not as requested!");
 
+    // Not fatal: transparent huge pages are only a hint
+    if (does_want_huge_pages && !is_on_hugetlbfs &&
+        madvise(addr, size, MADV_HUGEPAGE))
+        perror("madvise");
+
 #ifdef _NVDIMM_PROLIANT
     if (!does_exist) {
         // Try to pre-allocate storage space
-        int allocate_status = posix_fallocate(fd, 0, kPRegionSize_);
+        int allocate_status = posix_fallocate(fd, 0, size);
         assert(!allocate_status);
 
         // At least on some kernels, posix_fallocate does not appear to
         // be sufficient. Do a memset to force pre-allocation to make sure
         // all filesystem metadata changes are made.
-        memset(addr, 0, kPRegionSize_);
+        memset(addr, 0, size);
 
         // Force filesystem metadata changes to backing store
         fsync_paranoid(name);
     }
+#elif defined(_MSYNC_DURABILITY)
+    // The file and its directory entries must survive before any of
+    // its pages are synced
+    if (!does_exist) fsync_paranoid(name);
 #endif
     
     return fd;
 }
 
+///
+/// Start faulting in the populated ranges of a newly mapped region in
+/// the background if asked for
+///
+void PRegionMgr::startPrefault(PRegion *preg, int flags)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    if (!(flags & NVM_REGION_PREFAULT)) return;
+
+    PRegionPrefault *pf = new PRegionPrefault;
+    pf->ShouldStop_.store(false, std::memory_order_relaxed);
+    pf->IsWritable_ =
+        (flags & ~(NVM_REGION_HUGEPAGE | NVM_REGION_PREFAULT)) != O_RDONLY;
+    preg->getPopulatedRanges(&pf->Ranges_);
+    int status = pthread_create(&pf->Thread_, nullptr, prefault, pf);
+    assert(!status);
+    pthread_mutex_lock(&PrefaultsLock_);
+    assert(Prefaults_.find(preg->get_id()) == Prefaults_.end());
+    Prefaults_[preg->get_id()] = pf;
+    pthread_mutex_unlock(&PrefaultsLock_);
+}
+
+///
+/// Wait for the prefaulting of a region, if any, to stop. Must be
+/// called before the region is unmapped.
+///
+void PRegionMgr::stopPrefault(region_id_t rid)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    pthread_mutex_lock(&PrefaultsLock_);
+    std::map<region_id_t, PRegionPrefault*>::iterator ci =
+        Prefaults_.find(rid);
+    PRegionPrefault *pf = nullptr;
+    if (ci != Prefaults_.end()) {
+        pf = ci->second;
+        Prefaults_.erase(ci);
+    }
+    pthread_mutex_unlock(&PrefaultsLock_);
+    if (!pf) return;
+
+    pf->ShouldStop_.store(true, std::memory_order_release);
+    int status = pthread_join(pf->Thread_, nullptr);
+    assert(!status);
+    delete pf;
+}
+
+///
+/// Body of the prefaulting thread. The pages are populated without
+/// changing their contents, so this can run alongside the application.
+///
+void *PRegionMgr::prefault(void *arg)
+{
+    PRegionPrefault *pf = static_cast<PRegionPrefault*>(arg);
+    for (auto & range : pf->Ranges_) {
+        for (size_t off = 0; off < range.second; off += kPrefaultChunkSize_) {
+            if (pf->ShouldStop_.load(std::memory_order_acquire))
+                return nullptr;
+            char *start = range.first + off;
+            size_t sz = std::min(kPrefaultChunkSize_, range.second - off);
+#if defined(MADV_POPULATE_WRITE)
+            if (!madvise(start, sz, pf->IsWritable_ ?
+                         MADV_POPULATE_WRITE : MADV_POPULATE_READ))
+                continue;
+#endif
+            // Older kernels: a read fault of a shared mapping without
+            // dirty tracking maps the page writable
+            for (char *p = start; p < start + sz; p += kPageSize_)
+                (void)*static_cast<volatile char*>(p);
+        }
+    }
+    return nullptr;
+}
+
 ///
 /// Initialize the persistent region root
 ///    
@@ -613,19 +949,43 @@ void PRegionMgr::initPRegionRoot(PRegion *preg)
 
 ///
 /// Given a name, search the persistent region metadata and return a
-/// pointer to the corresponding metadata entry if it exists
+/// pointer to the corresponding metadata entry if it exists. The
+/// table lock must be held, in shared mode at least.
 ///    
-PRegion* PRegionMgr::searchPRegion(const char *name) const
+PRegion* PRegionMgr::searchPRegion(const char *name)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    PRegion *pregion_arr_ptr = getPRegionArrayPtr();
-    uint32_t curr = 0;
-    for (; curr < getNumPRegions(); ++curr, ++pregion_arr_ptr)
-        if (!strcmp(name, pregion_arr_ptr->get_name()))
-            return pregion_arr_ptr;
-    return nullptr;
+    pthread_mutex_lock(&NameIndexLock_);
+    // Index the entries added since the last search, possibly by
+    // another process
+    uint32_t num_regions = getNumPRegions();
+    while (NameIndex_.get_num_indexed() < num_regions) {
+        uint32_t rid = NameIndex_.get_num_indexed();
+        NameIndex_.insert(instantiateNewPRegion(rid)->get_name(), rid);
+    }
+    region_id_t rid = NameIndex_.find(name);
+    pthread_mutex_unlock(&NameIndexLock_);
+
+    if (rid == kInvalidPRegion_) return nullptr;
+    PRegion *preg = instantiateNewPRegion(rid);
+    // The entry may have been retired without a replacement yet
+    return strcmp(name, preg->get_name()) ? nullptr : preg;
+}
+
+void PRegionMgr::acquireSharedFLock()
+{
+    pthread_mutex_lock(&SharedFLockLock_);
+    if (!SharedFLockCount_++) flock(PRegionTableFD_, LOCK_SH);
+    pthread_mutex_unlock(&SharedFLockLock_);
+}
+
+void PRegionMgr::releaseSharedFLock()
+{
+    pthread_mutex_lock(&SharedFLockLock_);
+    if (!--SharedFLockCount_) flock(PRegionTableFD_, LOCK_UN);
+    pthread_mutex_unlock(&SharedFLockLock_);
 }
 
 ///
@@ -660,7 +1020,8 @@ std::pair<void*,region_id_t> PRegionMgr::ensurePRegionMapped(void *addr)
 
         if (addr >= curr_rgn->get_base_addr() && 
             static_cast<char*>(addr) <
-            static_cast<char*>(curr_rgn->get_base_addr())+kPRegionSize_) {
+            static_cast<char*>(curr_rgn->get_base_addr()) +
+            curr_rgn->get_size()) {
             initExistingPRegionImpl(curr_rgn, curr_rgn->get_name(), O_RDWR);
 
             tracePRegion(curr_rgn->get_id(), kFind_);
@@ -680,48 +1041,42 @@ std::pair<void*,region_id_t> PRegionMgr::ensurePRegionMapped(void *addr)
 /// region manager metadata
 ///
 
-// The following assumes interference-freedom, i.e. a lock must be held
-
-// TODO Is the old map leaked?
+// Updates copy the map and publish the copy under ExtentMapLock_, so
+// they may come from any number of threads. Readers load the map
+// without a lock, hence a replaced map is never freed.
 void PRegionMgr::insertExtent(
     void *first_addr, void *last_addr, region_id_t rid)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    PRegionExtentMap *old_map_ptr = ExtentMap_.load(std::memory_order_acquire);
-    PRegionExtentMap *new_map_ptr = nullptr;
-    do {
-        new_map_ptr = new PRegionExtentMap(*old_map_ptr);
-        new_map_ptr->insertExtent(reinterpret_cast<intptr_t>(first_addr),
-                        reinterpret_cast<intptr_t>(last_addr), rid);
-    }while (!ExtentMap_.compare_exchange_weak(
-                old_map_ptr, new_map_ptr,
-                std::memory_order_acq_rel, std::memory_order_relaxed));
+    pthread_mutex_lock(&ExtentMapLock_);
+    PRegionExtentMap *new_map_ptr =
+        new PRegionExtentMap(*ExtentMap_.load(std::memory_order_relaxed));
+    new_map_ptr->insertExtent(reinterpret_cast<intptr_t>(first_addr),
+                              reinterpret_cast<intptr_t>(last_addr), rid);
+    ExtentMap_.store(new_map_ptr, std::memory_order_release);
+    pthread_mutex_unlock(&ExtentMapLock_);
 }
 
 /// Delete a range of addresses and the corresponding region id from
 /// the region manager metadata
 ///    
 
-// The following assumes interference-freedom, i.e. a lock must be held
-
-// TODO Is the old map leaked?
+// Same concurrency contract as insertExtent
 void PRegionMgr::deleteExtent(
     void *first_addr, void *last_addr, region_id_t rid)
 {
 #ifdef _FORCE_FAIL
     fail_program();
 #endif
-    PRegionExtentMap *old_map_ptr = ExtentMap_.load(std::memory_order_acquire);
-    PRegionExtentMap *new_map_ptr = nullptr;
-    do {
-        new_map_ptr = new PRegionExtentMap(*old_map_ptr);
-        new_map_ptr->deleteExtent(reinterpret_cast<intptr_t>(first_addr),
-                                  reinterpret_cast<intptr_t>(last_addr), rid);
-    }while (!ExtentMap_.compare_exchange_weak(
-                old_map_ptr, new_map_ptr,
-                std::memory_order_acq_rel, std::memory_order_relaxed));
+    pthread_mutex_lock(&ExtentMapLock_);
+    PRegionExtentMap *new_map_ptr =
+        new PRegionExtentMap(*ExtentMap_.load(std::memory_order_relaxed));
+    new_map_ptr->deleteExtent(reinterpret_cast<intptr_t>(first_addr),
+                              reinterpret_cast<intptr_t>(last_addr), rid);
+    ExtentMap_.store(new_map_ptr, std::memory_order_release);
+    pthread_mutex_unlock(&ExtentMapLock_);
 }
 
 int PRegionMgr::getCacheLineSize() const
@@ -750,5 +1105,35 @@ void PRegionMgr::setCacheParams()
     PMallocUtil::set_cache_line_size(cache_line_size);
     PMallocUtil::set_cache_line_mask(0xffffffffffffffff - cache_line_size + 1);
 }
+
+///
+/// Number of NUMA nodes, taken as one more than the highest node id
+/// listed as online, e.g. "0-1" or "0,2-3"
+///    
+uint32_t PRegionMgr::getNumNumaNodes() const
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    uint32_t num_nodes = 1;
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp) {
+        int id;
+        while (fscanf(fp, "%d", &id) == 1) {
+            if (static_cast<uint32_t>(id) + 1 > num_nodes) num_nodes = id + 1;
+            if (fgetc(fp) == EOF) break; // skip separator
+        }
+        int status = fclose(fp);
+        assert(!status);
+    }
+    return num_nodes;
+}
+
+void PRegionMgr::setNumaParams()
+{
+#if defined(_ARENA_NUMA)
+    PMallocUtil::set_num_numa_nodes(getNumNumaNodes());
+#endif
+}
     
 } // namespace Atlas
@@ -19,6 +19,7 @@
 #include "atlas_alloc.h"
 #include "atlas_alloc_cpp.hpp"
 #include "pregion_mgr.hpp"
+#include "stats.hpp"
 
 using namespace Atlas;
 
@@ -27,6 +28,13 @@ uint32_t NVM_FindOrCreateRegion(const char *name, int flags, int *is_created)
     return PRegionMgr::getInstance().findOrCreatePRegion(
         name, flags, is_created);
 }
+
+uint32_t NVM_FindOrCreateRegionWithSize(
+    const char *name, int flags, uint64_t size, int *is_created)
+{
+    return PRegionMgr::getInstance().findOrCreatePRegion(
+        name, flags, is_created, size);
+}
     
 uint32_t NVM_FindRegion(const char *name, int flags)
 {
@@ -39,11 +47,28 @@ uint32_t NVM_CreateRegion(const char *name, int flags)
     return PRegionMgr::getInstance().createPRegion(name, flags);
 }
 
+uint32_t NVM_CreateRegionWithSize(const char *name, int flags, uint64_t size)
+{
+    return PRegionMgr::getInstance().createPRegion(name, flags, size);
+}
+
 void NVM_CloseRegion(uint32_t rid)
 {
     PRegionMgr::getInstance().closePRegion(rid);
 }
 
+#ifdef _REGION_SNAPSHOT
+int NVM_SnapshotRegion(uint32_t rid, const char *path)
+{
+    return PRegionMgr::getInstance().snapshotPRegion(rid, path);
+}
+
+int NVM_RestoreRegion(const char *path)
+{
+    return PRegionMgr::getInstance().restorePRegion(path);
+}
+#endif
+
 void NVM_DeleteRegion(const char *name)
 {
     PRegionMgr::getInstance().deletePRegion(name);
@@ -63,27 +88,72 @@ void *nvm_alloc(size_t sz, uint32_t rid)
 {
     bool does_need_cache_line_alignment = false;
     bool does_need_logging = true;
+    StatsRegistry::increment(kAllocCount);
+    StatsRegistry::increment(kAllocBytes, sz);
     return PRegionMgr::getInstance().allocMem(
         sz, rid, does_need_cache_line_alignment, does_need_logging);
 }
 
 void *nvm_calloc(size_t nmemb, size_t sz, uint32_t rid)
 {
+    StatsRegistry::increment(kAllocCount);
+    StatsRegistry::increment(kAllocBytes, nmemb * sz);
     return PRegionMgr::getInstance().callocMem(nmemb, sz, rid);
 }
 
 void *nvm_realloc(void *ptr, size_t sz, uint32_t rid)
 {
+    StatsRegistry::increment(kAllocCount);
+    StatsRegistry::increment(kAllocBytes, sz);
     return PRegionMgr::getInstance().reallocMem(ptr, sz, rid);
 }
 
 void nvm_free(void *ptr)
 {
+    StatsRegistry::increment(kFreeCount);
     PRegionMgr::getInstance().freeMem(ptr);
 }
 
+void nvm_alloc_batch(const size_t *sizes, size_t n, uint32_t rid, void **out)
+{
+    bool does_need_logging = true;
+    StatsRegistry::increment(kAllocCount, n);
+    for (size_t i = 0; i < n; ++i)
+        StatsRegistry::increment(kAllocBytes, sizes[i]);
+    PRegionMgr::getInstance().allocMemBatch(
+        sizes, n, rid, out, does_need_logging);
+}
+
+void nvm_free_batch(void **ptrs, size_t n)
+{
+    StatsRegistry::increment(kFreeCount, n);
+    PRegionMgr::getInstance().freeMemBatch(ptrs, n);
+}
+
+void *nvm_pool_create(uint32_t rid, size_t obj_size, size_t align)
+{
+    return PRegionMgr::getInstance().getPRegion(rid)->createPool(
+        obj_size, align);
+}
+
+void *nvm_pool_alloc(void *pool)
+{
+    PPool *ppool = static_cast<PPool*>(pool);
+    StatsRegistry::increment(kAllocCount);
+    StatsRegistry::increment(kAllocBytes, ppool->get_obj_size());
+    return ppool->allocMem(
+        PRegionMgr::getInstance().getPRegion(ppool->get_region_id()));
+}
+
+void nvm_pool_free(void *pool, void *ptr)
+{
+    StatsRegistry::increment(kFreeCount);
+    static_cast<PPool*>(pool)->freeMem(ptr);
+}
+
 void nvm_delete(void *ptr)
 {
+    StatsRegistry::increment(kFreeCount);
     PRegionMgr::getInstance().deleteMem(ptr);
 }
 
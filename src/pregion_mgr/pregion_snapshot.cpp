@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "atlas_alloc.h"
+#include "pregion_mgr.hpp"
+#include "log_mgr.hpp"
+#include "util.hpp"
+#include "fail.hpp"
+#include "fsync.hpp"
+
+// Older kernel headers lack it
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+namespace Atlas {
+
+///
+/// Copy the first size bytes of a file into another one, skipping
+/// holes. Returns 0 on success, otherwise -1 with errno set.
+///
+static int copyFileData(int src_fd, int dst_fd, uint64_t size)
+{
+    std::vector<char> buf;
+    loff_t off = 0;
+    while (off < static_cast<loff_t>(size)) {
+        loff_t start = lseek(src_fd, off, SEEK_DATA);
+        if (start == -1 && errno == ENXIO) break; // a hole up to the end
+        if (start == -1) start = off; // holes are not reported
+        loff_t end = lseek(src_fd, start, SEEK_HOLE);
+        if (end == -1 || end > static_cast<loff_t>(size)) end = size;
+        off = start;
+        while (off < end) {
+            loff_t dst_off = off;
+            ssize_t n = copy_file_range(
+                src_fd, &off, dst_fd, &dst_off, end - off, 0);
+            if (n > 0) continue;
+            // Not between these files, copy through user space
+            if (buf.empty()) buf.resize(kSnapshotChunkSize_);
+            n = pread(src_fd, &buf[0],
+                      std::min(static_cast<loff_t>(buf.size()), end - off),
+                      off);
+            if (n > 0 && pwrite(dst_fd, &buf[0], n, off) != n) n = -1;
+            if (n <= 0) {
+                if (!n) errno = EIO;
+                return -1;
+            }
+            off += n;
+        }
+    }
+    return 0;
+}
+
+///
+/// Write a copy of an open region to a file. The copy is taken while
+/// the failure-atomic sections are paused and the allocators of the
+/// region are locked, so it reflects completed sections only. The
+/// file holds the region contents followed by the region descriptor
+/// and the layout word of the region table. Returns 0 on success,
+/// otherwise -1 with errno set.
+///
+int PRegionMgr::snapshotPRegion(region_id_t rid, const char *path)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    acquireSharedTableLock();
+    bool is_candidate = isSnapshotCandidate(rid);
+    releaseTableLock();
+    if (!is_candidate) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) return -1;
+
+    // Nothing is held yet: a section in progress may need the locks
+    // below to end
+    if (!pauseForSnapshot()) {
+        close(fd);
+        unlink(path);
+        errno = EBUSY;
+        return -1;
+    }
+
+    acquireSharedTableLock();
+    // Keeps the region from being closed
+    acquirePRegionLock(rid);
+    int status = -1;
+    char trailer[sizeof(PRegion) + sizeof(uint64_t)];
+    PRegion *preg = getPRegion(rid);
+    // It may have been closed before the pause
+    if (isSnapshotCandidate(rid)) {
+        preg->lockAllocators();
+        std::memcpy(trailer, static_cast<void*>(preg), sizeof(PRegion));
+        status = copyPRegion(preg, fd);
+        preg->unlockAllocators();
+    }
+    else errno = EINVAL;
+    if (LogMgr::hasInstance()) LogMgr::getInstance().resumeFases();
+
+    uint64_t size = preg->get_size();
+    releasePRegionLock(rid);
+    releaseTableLock();
+
+    // Only the persistent fields of the descriptor are meaningful
+    std::memcpy(trailer + sizeof(PRegion), &kPRegionTableMagic_,
+                sizeof(uint64_t));
+    if (!status &&
+        (pwrite(fd, trailer, sizeof(trailer), size) !=
+         static_cast<ssize_t>(sizeof(trailer)) || fsync(fd)))
+        status = -1;
+    int saved_errno = errno;
+    close(fd);
+    if (status) unlink(path);
+    errno = saved_errno;
+    return status;
+}
+
+///
+/// Tell whether a region can be snapshotted: it must be open in this
+/// process and must not be the log region. The table lock must be
+/// held.
+///
+bool PRegionMgr::isSnapshotCandidate(region_id_t rid) const
+{
+    if (rid >= getNumPRegions()) return false;
+    PRegion *preg = getPRegion(rid);
+    return !preg->is_deleted() && isPRegionMappedHere(preg) &&
+        (!LogMgr::hasInstance() ||
+         LogMgr::getInstance().getRegionId() != rid);
+}
+
+///
+/// Pause the failure-atomic sections, retrying a number of times if
+/// the sections in progress do not end in time. In between attempts,
+/// sections held back while another one waits for their locks can go
+/// on, which keeps a pause to kSnapshotFaseWaitMs_ at most.
+///
+bool PRegionMgr::pauseForSnapshot() const
+{
+    if (!LogMgr::hasInstance()) return true;
+    for (uint32_t i = 0; i < kMaxSnapshotAttempts_; ++i) {
+        if (LogMgr::getInstance().pauseFases(kSnapshotFaseWaitMs_))
+            return true;
+        usleep(kSnapshotFaseWaitMs_ * 1000);
+    }
+    return false;
+}
+
+///
+/// Copy the contents of a region into an empty file. The region file
+/// is cloned if the file system supports it, which only takes the
+/// time of a metadata update. Otherwise the parts of the region that
+/// may hold data are copied by several threads.
+///
+int PRegionMgr::copyPRegion(PRegion *preg, int fd) const
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    if (!ioctl(fd, FICLONE, preg->get_file_desc())) return 0;
+
+    // The sections are held back for as long as the copy takes
+    std::vector<std::pair<char*, size_t> > ranges;
+    preg->getWrittenRanges(&ranges);
+    uint64_t total_sz = 0;
+    for (auto & range : ranges) total_sz += range.second;
+    if (total_sz > kMaxSnapshotCopySize_) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    // Everything not copied below reads as zero
+    if (ftruncate(fd, preg->get_size())) return -1;
+
+    PRegionSnapshotCopy copy;
+    copy.SrcFD_ = preg->get_file_desc();
+    copy.DstFD_ = fd;
+    copy.BaseAddr_ = static_cast<char*>(preg->get_base_addr());
+    for (auto & range : ranges)
+        for (size_t off = 0; off < range.second; off += kSnapshotChunkSize_)
+            copy.Pieces_.push_back(std::make_pair(
+                range.first + off,
+                std::min(kSnapshotChunkSize_, range.second - off)));
+    copy.NextPiece_.store(0, std::memory_order_relaxed);
+    copy.IsInKernel_.store(true, std::memory_order_relaxed);
+    copy.Errno_.store(0, std::memory_order_relaxed);
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = std::min(
+        std::min(static_cast<size_t>(kMaxSnapshotThreads_),
+                 static_cast<size_t>(num_cpus > 0 ? num_cpus : 1)),
+        copy.Pieces_.size());
+    // The calling thread is one of them
+    std::vector<pthread_t> threads(num_threads ? num_threads - 1 : 0);
+    for (auto & thread : threads) {
+        int status = pthread_create(&thread, nullptr,
+                                    copySnapshotPieces, &copy);
+        assert(!status);
+    }
+    copySnapshotPieces(&copy);
+    for (auto & thread : threads) {
+        int status = pthread_join(thread, nullptr);
+        assert(!status);
+    }
+
+    int copy_errno = copy.Errno_.load(std::memory_order_relaxed);
+    if (!copy_errno) return 0;
+    errno = copy_errno;
+    return -1;
+}
+
+///
+/// Body of a thread copying a region into a snapshot. Pieces are
+/// copied within the kernel where possible, otherwise written out
+/// from the mapping of the region.
+///
+void *PRegionMgr::copySnapshotPieces(void *arg)
+{
+    PRegionSnapshotCopy *copy = static_cast<PRegionSnapshotCopy*>(arg);
+    for (;;) {
+        size_t i = copy->NextPiece_.fetch_add(1, std::memory_order_relaxed);
+        if (i >= copy->Pieces_.size() ||
+            copy->Errno_.load(std::memory_order_relaxed))
+            break;
+        char *start = copy->Pieces_[i].first;
+        size_t sz = copy->Pieces_[i].second;
+        while (sz) {
+            loff_t off = start - copy->BaseAddr_;
+            loff_t dst_off = off;
+            ssize_t n = -1;
+            if (copy->IsInKernel_.load(std::memory_order_relaxed)) {
+                n = copy_file_range(copy->SrcFD_, &off, copy->DstFD_,
+                                    &dst_off, sz, 0);
+                if (n <= 0)
+                    copy->IsInKernel_.store(false, std::memory_order_relaxed);
+            }
+            if (n <= 0) n = pwrite(copy->DstFD_, start, sz, dst_off);
+            if (n <= 0) {
+                copy->Errno_.store(n ? errno : EIO, std::memory_order_relaxed);
+                break;
+            }
+            start += n;
+            sz -= n;
+        }
+    }
+    return nullptr;
+}
+
+///
+/// Bring a region back to the contents of a snapshot taken from it.
+/// The snapshot names the region table entry it was taken from, which
+/// must still hold that region, possibly deleted. The region must not
+/// be open. The entry is marked deleted until both the region file
+/// and the entry match the snapshot, so a restore that fails midway
+/// can be run again. Returns 0 on success, otherwise -1 with errno
+/// set.
+///
+int PRegionMgr::restorePRegion(const char *path)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+
+    alignas(PRegion) char desc[sizeof(PRegion)];
+    PRegion *snap = reinterpret_cast<PRegion*>(desc);
+    uint64_t magic = 0;
+    struct stat stat_buffer;
+    off_t size = -1;
+    if (!fstat(fd, &stat_buffer))
+        size = stat_buffer.st_size - sizeof(desc) - sizeof(magic);
+    if (size <= 0 ||
+        pread(fd, desc, sizeof(desc), size) !=
+        static_cast<ssize_t>(sizeof(desc)) ||
+        pread(fd, &magic, sizeof(magic), size + sizeof(desc)) !=
+        static_cast<ssize_t>(sizeof(magic)) ||
+        magic != kPRegionTableMagic_ ||
+        snap->get_size() != static_cast<uint64_t>(size) ||
+        !memchr(snap->get_name(), '\0', kMaxlen_)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    acquireTableLock();
+    acquireExclusiveFLock();
+
+    region_id_t rid = snap->get_id();
+    PRegion *preg = rid < getNumPRegions() ? getPRegion(rid) : nullptr;
+    int status = -1;
+    // The pointers within the region are only valid at its old
+    // addresses
+    if (!preg || searchPRegion(snap->get_name()) != preg ||
+        preg->get_base_addr() != snap->get_base_addr() ||
+        preg->get_size() != snap->get_size())
+        errno = EINVAL;
+    else if (isPRegionMappedHere(preg))
+        errno = EBUSY;
+    else {
+        if (!preg->is_deleted()) preg->set_is_deleted(true);
+        status = restorePRegionFile(fd, snap->get_name(), size);
+    }
+    if (!status) {
+        // The transients are set up again when the region is opened
+        snap->set_is_mapped(false);
+        snap->set_is_deleted(true);
+        snap->set_file_desc(-1);
+        std::memcpy(static_cast<void*>(preg), desc, sizeof(PRegion));
+        NVM_PSYNC(preg, sizeof(PRegion));
+        preg->set_is_deleted(false);
+    }
+
+    releaseFLock();
+    releaseTableLock();
+
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return status;
+}
+
+///
+/// Replace the file of a region with the first size bytes of a
+/// snapshot. They are written to a new file first, which is renamed
+/// over the region file once durable.
+///
+int PRegionMgr::restorePRegionFile(
+    int fd, const char *name, uint64_t size) const
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    char *region_name = NVM_GetFullyQualifiedRegionName(name);
+    std::string tmp_name = std::string(region_name) + ".restore";
+    int tmp_fd = open(tmp_name.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                      S_IRUSR | S_IWUSR);
+    int status = tmp_fd == -1 ? -1 : 0;
+    // A clone takes the trailer along, it is cut off below
+    if (!status && ioctl(tmp_fd, FICLONE, fd))
+        status = copyFileData(fd, tmp_fd, size);
+    if (!status && (ftruncate(tmp_fd, size) || fsync(tmp_fd))) status = -1;
+    if (!status && rename(tmp_name.c_str(), region_name)) status = -1;
+    int saved_errno = errno;
+    if (tmp_fd != -1) close(tmp_fd);
+    if (status) unlink(tmp_name.c_str());
+#if defined(_NVDIMM_PROLIANT) || defined(_MSYNC_DURABILITY)
+    else {
+        char *parent = strdup(region_name);
+        fsync_dir(parent);
+        free(parent);
+    }
+#endif
+    free(region_name);
+    errno = saved_errno;
+    return status;
+}
+
+} // namespace Atlas
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "atlas_api.h"
+#include "atlas_alloc.h"
+
+// Compares the page faults and TLB misses a program takes on a region
+// opened plainly, with huge pages, with prefaulting, and with both.
+// The region holds a single block of data, which is stored to once
+// per page right after the open, as the first FASEs would, and then
+// read at random places.
+
+const char *kRegionName = "atlas_bench_faults";
+const uint64_t kRandomReads = 1 << 24;
+const uint64_t kPage = 4096;
+
+static double getTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static long getMinorFaults()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+// Counts data TLB read misses of this thread in user mode. Returns -1
+// if the counter is not available, e.g. in a virtual machine.
+static int openTlbMissCounter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// The input is optionally the size of the data in MB, followed by the
+// time in ms given to the prefaulting thread before the data is used
+int main(int argc, char **argv)
+{
+    assert(argc <= 3);
+    uint64_t size = (argc > 1 ? atol(argv[1]) : 1024) << 20;
+    long settle_ms = argc > 2 ? atol(argv[2]) : 500;
+    assert(size);
+
+    NVM_Initialize();
+
+    // The data goes to an extent, in the upper half of the region
+    int is_created;
+    uint32_t rid = NVM_FindOrCreateRegionWithSize(
+        kRegionName, O_RDWR, 2 * size + (64 << 20), &is_created);
+    if (!is_created) {
+        NVM_CloseRegion(rid);
+        NVM_DeleteRegion(kRegionName);
+        rid = NVM_CreateRegionWithSize(
+            kRegionName, O_RDWR, 2 * size + (64 << 20));
+    }
+    char *data = (char*)nvm_alloc(size, rid);
+    assert(data);
+    memset(data, 1, size);
+    NVM_SetRegionRoot(rid, data);
+    NVM_CloseRegion(rid);
+
+    int tlb_fd = openTlbMissCounter();
+
+    const char *names[] = { "plain", "hugepage", "prefault",
+                            "hugepage+prefault" };
+    int flags[] = { 0, NVM_REGION_HUGEPAGE, NVM_REGION_PREFAULT,
+                    NVM_REGION_HUGEPAGE | NVM_REGION_PREFAULT };
+    printf("%lu MB of data, %lu random reads\n",
+           (unsigned long)(size >> 20), (unsigned long)kRandomReads);
+    printf("%-18s %12s %12s %14s %12s\n", "open", "faults",
+           "touch-ms", "dtlb-misses", "random-ms");
+    for (int i = 0; i < 4; ++i) {
+        rid = NVM_FindRegion(kRegionName, O_RDWR | flags[i]);
+        if (flags[i] & NVM_REGION_PREFAULT) usleep(settle_ms * 1000);
+        data = (char*)NVM_GetRegionRoot(rid);
+
+        long faults = getMinorFaults();
+        double start_ms = getTimeMs();
+        for (uint64_t off = 0; off < size; off += kPage) ++data[off];
+        double touch_ms = getTimeMs() - start_ms;
+        faults = getMinorFaults() - faults;
+
+        if (tlb_fd != -1) {
+            ioctl(tlb_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(tlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        start_ms = getTimeMs();
+        uint64_t x = 88172645463325252ULL;
+        uint64_t sum = 0;
+        for (uint64_t n = 0; n < kRandomReads; ++n) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            sum += data[x % size];
+        }
+        double random_ms = getTimeMs() - start_ms;
+        char misses[32] = "n/a";
+        if (tlb_fd != -1) {
+            ioctl(tlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count;
+            if (read(tlb_fd, &count, sizeof(count)) == sizeof(count))
+                snprintf(misses, sizeof(misses), "%lu",
+                         (unsigned long)count);
+        }
+        // Keeps the reads from being optimized away
+        if (sum == 1) printf("\n");
+
+        printf("%-18s %12ld %12.1f %14s %12.1f\n", names[i], faults,
+               touch_ms, misses, random_ms);
+        NVM_CloseRegion(rid);
+    }
+
+    if (tlb_fd != -1) close(tlb_fd);
+    NVM_DeleteRegion(kRegionName);
+    NVM_Finalize();
+    return 0;
+}
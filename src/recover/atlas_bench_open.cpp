@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+#include <vector>
+
+#include "atlas_api.h"
+#include "atlas_alloc.h"
+#include "pregion_mgr.hpp"
+
+using namespace Atlas;
+
+// Measures the time and the memory it takes to open many regions, and
+// then to use a few arenas in each of them. Arena transients are set
+// up on first use, so both should grow with the arenas used rather
+// than with the arenas there are.
+
+static double getTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Resident set size of this process in KB
+static long getRssKB()
+{
+    long size = 0, pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &size, &pages) != 2) pages = 0;
+        fclose(fp);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void getRegionName(char *name, size_t sz, uint32_t i)
+{
+    snprintf(name, sz, "atlas_bench_open_%u", i);
+}
+
+// The input is optionally the number of regions, followed by the
+// number of arenas used in each
+int main(int argc, char **argv)
+{
+    assert(argc <= 3);
+    uint32_t num_regions = argc > 1 ? atoi(argv[1]) : 200;
+    uint32_t num_used = argc > 2 ? atoi(argv[2]) : 1;
+    assert(num_regions && num_regions < kMaxNumPRegions_ - 1);
+
+    NVM_Initialize();
+
+    // The regions are opened below, not as they are created
+    char name[64];
+    for (uint32_t i = 0; i < num_regions; ++i) {
+        getRegionName(name, sizeof(name), i);
+        NVM_CloseRegion(NVM_FindOrCreateRegion(name, O_RDWR, NULL));
+    }
+
+    std::vector<uint32_t> rids(num_regions);
+    long rss_kb = getRssKB();
+    double start_ms = getTimeMs();
+    for (uint32_t i = 0; i < num_regions; ++i) {
+        getRegionName(name, sizeof(name), i);
+        rids[i] = NVM_FindRegion(name, O_RDWR);
+    }
+    double open_ms = getTimeMs() - start_ms;
+    long open_rss_kb = getRssKB() - rss_kb;
+
+    uint32_t num_arenas =
+        PRegionMgr::getInstance().getPRegion(rids[0])->get_num_arenas();
+    if (num_used > num_arenas) num_used = num_arenas;
+    rss_kb = getRssKB();
+    start_ms = getTimeMs();
+    for (uint32_t i = 0; i < num_regions; ++i)
+        for (uint32_t a = 0; a < num_used; ++a) {
+            PMallocUtil::set_tl_curr_arena(rids[i], a);
+            nvm_free(nvm_alloc(64, rids[i]));
+        }
+    double use_ms = getTimeMs() - start_ms;
+    long use_rss_kb = getRssKB() - rss_kb;
+
+    printf("%u regions of %u arenas\n", num_regions, num_arenas);
+    printf("%-28s %10s %10s\n", "", "ms", "RSS-KB");
+    printf("%-28s %10.1f %10ld\n", "open", open_ms, open_rss_kb);
+    char label[64];
+    snprintf(label, sizeof(label), "first use of %u arena(s)", num_used);
+    printf("%-28s %10.1f %10ld\n", label, use_ms, use_rss_kb);
+
+    for (uint32_t i = 0; i < num_regions; ++i) {
+        NVM_CloseRegion(rids[i]);
+        getRegionName(name, sizeof(name), i);
+        NVM_DeleteRegion(name);
+    }
+    NVM_Finalize();
+    return 0;
+}
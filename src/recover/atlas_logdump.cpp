@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <assert.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "atlas_alloc.h"
+#include "util.hpp"
+#include "pregion_configs.hpp"
+#include "pregion_mgr.hpp"
+#include "log_structure.hpp"
+
+using namespace Atlas;
+
+// Summarizes the log left behind by a crashed process without changing
+// it: the log region is mapped read-only and every log entry is visited
+// once. Meant for triage before running recover.
+
+const uint32_t kNumLogTypes = LE_pool_free + 1;
+
+static const char *const kLogTypeNames[kNumLogTypes] = {
+    "dummy", "acquire", "rwlock_rdlock", "rwlock_wrlock",
+    "begin_durable", "release", "rwlock_unlock", "end_durable",
+    "str", "memset", "memcpy", "memmove",
+    "strcpy", "strcat", "alloc", "free",
+    "alloc_batch", "free_batch", "pool_alloc", "pool_free"
+};
+
+// Rough costs of recovery, measured on a single core. The helper
+// thread goes through the entries of complete failure-atomic sections
+// to advance the consistent state, the rest is undone.
+const double kHelperNsPerFaseEntry = 1500;
+const double kUndoNsPerEntry = 250;
+const double kUndoNsPerMemopByte = 1;
+
+struct ThreadLogStats {
+    uint64_t NumEntries;
+    uint64_t TypeCounts[kNumLogTypes];
+    uint64_t MemopBytes; // data saved by memops and string ops
+    uint64_t NumFases; // complete outermost sections
+    uint64_t NumFaseEntries; // entries in the above
+    bool IsInFase; // a section is open at the end of the log
+    uint64_t NumCrossEdges; // happens-before edges from other threads
+    uint64_t NumLocalEdges; // from this thread, implied by program order
+    uint64_t NumPrunedEdges; // from log entries pruned already
+};
+
+// Threads are numbered in the order of their log structures, the most
+// recently created first
+
+// A run of log entries adjacent in memory, all of a single thread. Log
+// entries come from per-thread circular buffers, so there are few runs.
+struct LogRun {
+    uintptr_t Lo;
+    uintptr_t Hi; // past the last log entry
+    uint32_t Tid;
+    bool operator<(const LogRun & other) const { return Lo < other.Lo; }
+};
+
+static void scanThreadLog(LogEntry *le, uint32_t tid, ThreadLogStats *stats,
+                          std::vector<LogRun> *runs,
+                          std::vector<LogEntry*> *acquires)
+{
+    uint32_t depth = 0;
+    uint64_t fase_entries = 0;
+    for (; le; le = le->Next.load(std::memory_order_relaxed)) {
+        ++ stats->NumEntries;
+        ++ stats->TypeCounts[le->Type < kNumLogTypes ? le->Type : 0];
+        if (le->isMemop() || le->isStrop()) stats->MemopBytes += le->Size;
+
+        if (depth) ++ fase_entries;
+        if (le->isStartSection() && !depth ++) fase_entries = 1;
+        else if (le->isEndSection() && depth && !-- depth) {
+            ++ stats->NumFases;
+            stats->NumFaseEntries += fase_entries;
+        }
+
+        // Same test as the recovery for a happens-before source
+        if ((le->isStartSection() || le->isAllocation() ||
+             le->isDeallocation()) && le->ValueOrPtr)
+            acquires->push_back(le);
+
+        uintptr_t addr = (uintptr_t)le;
+        if (!runs->empty() && runs->back().Tid == tid &&
+            runs->back().Hi == addr)
+            runs->back().Hi = addr + sizeof(LogEntry);
+        else runs->push_back({addr, addr + sizeof(LogEntry), tid});
+    }
+    stats->IsInFase = depth;
+}
+
+// Thread a log entry belongs to, or -1 if it is not in the log anymore
+static int findThread(const std::vector<LogRun> & runs, LogEntry *le)
+{
+    LogRun key = {(uintptr_t)le, 0, 0};
+    std::vector<LogRun>::const_iterator ci =
+        std::upper_bound(runs.begin(), runs.end(), key);
+    if (ci == runs.begin()) return -1;
+    -- ci;
+    return (uintptr_t)le < ci->Hi ? (int)ci->Tid : -1;
+}
+
+static void printStats(const char *title, const ThreadLogStats & stats)
+{
+    printf("%s: %lu entries, %lu complete FASEs%s, %lu memop bytes\n",
+           title, (unsigned long)stats.NumEntries,
+           (unsigned long)stats.NumFases,
+           stats.IsInFase ? " + 1 open" : "",
+           (unsigned long)stats.MemopBytes);
+    printf("  ");
+    for (uint32_t t = 0; t < kNumLogTypes; ++ t)
+        if (stats.TypeCounts[t])
+            printf(" %s=%lu", kLogTypeNames[t],
+                   (unsigned long)stats.TypeCounts[t]);
+    printf("\n   edges: cross-thread=%lu same-thread=%lu to-pruned=%lu\n",
+           (unsigned long)stats.NumCrossEdges,
+           (unsigned long)stats.NumLocalEdges,
+           (unsigned long)stats.NumPrunedEdges);
+}
+
+// The input should be the name of the executable whose log is to be dumped
+int main(int argc, char **argv)
+{
+    assert(argc == 2);
+
+    PRegionMgr::createInstance();
+
+    char *log_name = NVM_GetLogRegionName(argv[1]);
+    if (!NVM_doesLogExist(NVM_GetFullyQualifiedRegionName(log_name))) {
+        fprintf(stderr, "Log for %s not found, nothing to do\n", argv[1]);
+        free(log_name);
+        return 0;
+    }
+    region_id_t log_rid =
+        PRegionMgr::getInstance().findPRegion(log_name, O_RDONLY);
+    assert(log_rid != kInvalidPRegion_ &&
+           "Log region not found in region table!");
+
+    LogStructure **lsh_p = (LogStructure**)NVM_GetRegionRoot(log_rid);
+    LogStructure *lsp = lsh_p ? *lsh_p : nullptr;
+
+    std::vector<ThreadLogStats> stats;
+    std::vector<LogRun> runs;
+    std::vector<LogEntry*> acquires;
+    std::vector<uint32_t> acquire_offsets;
+    for (; lsp; lsp = lsp->Next) {
+        acquire_offsets.push_back(acquires.size());
+        stats.push_back(ThreadLogStats());
+        scanThreadLog(lsp->Le, stats.size() - 1, &stats.back(),
+                      &runs, &acquires);
+    }
+    acquire_offsets.push_back(acquires.size());
+
+    // Classify the happens-before edges the way the recovery does: the
+    // source may have been pruned and its log entry reused, in which
+    // case the generation numbers differ
+    std::sort(runs.begin(), runs.end());
+    for (uint32_t tid = 0; tid < stats.size(); ++ tid)
+        for (uint32_t i = acquire_offsets[tid];
+             i < acquire_offsets[tid + 1]; ++ i) {
+            LogEntry *acq_le = acquires[i];
+            LogEntry *rel_le = (LogEntry*)acq_le->ValueOrPtr;
+            int rel_tid = findThread(runs, rel_le);
+            if (rel_tid == -1 ||
+                !(rel_le->isEndSection() || rel_le->isDeallocation()) ||
+                rel_le->Size != acq_le->Size)
+                ++ stats[tid].NumPrunedEdges;
+            else if ((uint32_t)rel_tid == tid) ++ stats[tid].NumLocalEdges;
+            else ++ stats[tid].NumCrossEdges;
+        }
+
+    ThreadLogStats total = ThreadLogStats();
+    for (uint32_t tid = 0; tid < stats.size(); ++ tid) {
+        char title[32];
+        snprintf(title, sizeof(title), "thread %u", tid);
+        printStats(title, stats[tid]);
+
+        total.NumEntries += stats[tid].NumEntries;
+        for (uint32_t t = 0; t < kNumLogTypes; ++ t)
+            total.TypeCounts[t] += stats[tid].TypeCounts[t];
+        total.MemopBytes += stats[tid].MemopBytes;
+        total.NumFases += stats[tid].NumFases;
+        total.NumFaseEntries += stats[tid].NumFaseEntries;
+        total.NumCrossEdges += stats[tid].NumCrossEdges;
+        total.NumLocalEdges += stats[tid].NumLocalEdges;
+        total.NumPrunedEdges += stats[tid].NumPrunedEdges;
+    }
+    printStats("total", total);
+    printf("%lu threads, %lu runs of log entries\n",
+           (unsigned long)stats.size(), (unsigned long)runs.size());
+
+    // Whether the helper thread can prune a complete section depends
+    // on the open ones, so the estimate is a range: from nothing pruned
+    // to all complete sections pruned
+    double undo_ns = total.NumEntries * kUndoNsPerEntry +
+        total.MemopBytes * kUndoNsPerMemopByte;
+    double helper_ns = total.NumFaseEntries *
+        (kHelperNsPerFaseEntry - kUndoNsPerEntry);
+    printf("estimated recovery time: %.1f to %.1f ms (single core, rough)\n",
+           undo_ns / 1e6, (undo_ns + helper_ns) / 1e6);
+
+    PRegionMgr::getInstance().closePRegion(log_rid);
+    PRegionMgr::deleteInstance();
+    free(log_name);
+    return 0;
+}
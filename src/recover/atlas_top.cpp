@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024, ITGSS Corporation. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * Contact with ITGSS, 651 N Broad St, Suite 201, in the
+ * city of Middletown, zip code 19709, and county of New Castle, state of Delaware.
+ * or visit www.it-gss.com if you need additional information or have any
+ * questions.
+ *
+ */
+ 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "util.hpp"
+#include "log_structure.hpp"
+#include "stats_page.hpp"
+
+using namespace Atlas;
+
+// Shows what a running Atlas process is doing, a line per interval,
+// from the stats page it publishes. Attaches read-only and never
+// blocks the process.
+
+const uint32_t kHeaderPeriod = 20; // lines between headers
+
+static void printHeader()
+{
+    printf("%10s %10s %10s %10s %10s %10s %10s\n",
+           "FASE/s", "logged/s", "flushes/s", "log-MB", "logbuf-MB",
+           "lag-ms", "waits/s");
+}
+
+// Is the process still there, whether or not we may signal it?
+static bool isAlive(uint64_t pid)
+{
+    return !kill((pid_t)pid, 0) || errno == EPERM;
+}
+
+// The input should be the name of the executable to watch, optionally
+// followed by the interval in seconds and the number of lines
+int main(int argc, char **argv)
+{
+    assert(argc >= 2 && argc <= 4);
+    double interval_s = argc > 2 ? atof(argv[2]) : 1;
+    long count = argc > 3 ? atol(argv[3]) : -1;
+    assert(interval_s > 0);
+
+    char *path = NVM_GetStatsPagePath(argv[1]);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "No stats page for %s at %s\n", argv[1], path);
+        free(path);
+        return 1;
+    }
+    free(path);
+    void *addr = mmap(nullptr, sizeof(StatsPage), PROT_READ, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    const StatsPage *page = static_cast<const StatsPage*>(addr);
+    if (page->Magic_ != kStatsPageMagic) {
+        fprintf(stderr, "%s has not published its stats yet\n", argv[1]);
+        return 1;
+    }
+
+    StatsSample prev, curr;
+    if (!page->read(&prev) || !isAlive(prev.Pid)) {
+        fprintf(stderr, "%s is not running\n", argv[1]);
+        return 1;
+    }
+    for (long line = 0; count < 0 || line < count; ++line) {
+        usleep((useconds_t)(interval_s * 1e6));
+        if (!page->read(&curr) || !isAlive(curr.Pid)) {
+            fprintf(stderr, "%s is not running anymore\n", argv[1]);
+            return 0;
+        }
+        // The page is updated periodically, not at every read
+        if (curr.TimeNs == prev.TimeNs) { --line; continue; }
+        if (!(line % kHeaderPeriod)) printHeader();
+
+        double dt = (curr.TimeNs - prev.TimeNs) / 1e9;
+#define RATE(c) ((curr.Counters[c] - prev.Counters[c]) / dt)
+        uint64_t outstanding = curr.Counters[kLogEntryCount] -
+            curr.Counters[kPrunedLogEntryCount];
+        printf("%10.0f %10.0f %10.0f %10.1f %10.1f %10.1f %10.0f\n",
+               RATE(kFaseCount), RATE(kLoggedStoreCount),
+               RATE(kFlushCount),
+               outstanding * sizeof(LogEntry) / 1048576.0,
+               curr.Counters[kLogMemUse] / 1048576.0,
+               curr.HelperLagNs / 1e6, RATE(kArenaLockWaitCount));
+#undef RATE
+        fflush(stdout);
+        prev = curr;
+    }
+    return 0;
+}
@@ -18,7 +18,9 @@
 
 #include <iostream>
 #include <string>
+#include <new>
 
+#include <stdlib.h>
 #include <pthread.h>
 
 #include "atlas_api.h"
@@ -73,5 +75,145 @@ void Stats::print()
     releaseLock();
 }
 
+std::atomic<StatsRegistry::StatsSlot*> StatsRegistry::Slots_{nullptr};
+pthread_key_t StatsRegistry::SlotKey_;
+pthread_once_t StatsRegistry::SlotKeyOnce_ = PTHREAD_ONCE_INIT;
+thread_local StatsRegistry::StatsSlot *StatsRegistry::TL_Slot_{nullptr};
+thread_local uint64_t StatsRegistry::TL_PublishedFlushes_{0};
+
+void StatsRegistry::createSlotKey()
+{
+    int status = pthread_key_create(&SlotKey_, releaseSlot);
+    assert(!status);
+}
+
+///
+/// @brief Take over the slot of a thread that exited, or add a new
+/// one, and arrange for it to be handed back at thread exit
+///
+StatsRegistry::StatsSlot *StatsRegistry::acquireSlot()
+{
+    pthread_once(&SlotKeyOnce_, createSlotKey);
+
+    StatsSlot *slot = Slots_.load(std::memory_order_acquire);
+    for (; slot; slot = slot->Next_) {
+        bool is_in_use = false;
+        if (!slot->IsInUse_.load(std::memory_order_relaxed) &&
+            slot->IsInUse_.compare_exchange_strong(
+                is_in_use, true, std::memory_order_acquire))
+            break;
+    }
+    if (!slot) {
+        // A slot does not share cache lines with another one
+        void *mem;
+        int status = posix_memalign(
+            &mem, kDCacheLineSize_,
+            (sizeof(StatsSlot) + kDCacheLineSize_ - 1) &
+            ~(kDCacheLineSize_ - 1));
+        assert(!status);
+        slot = new (mem) StatsSlot;
+        for (uint32_t i = 0; i < kNumStatsCounters; ++i)
+            slot->Counters_[i].store(0, std::memory_order_relaxed);
+        for (uint32_t h = 0; h < kNumStatsHistograms; ++h)
+            for (uint32_t i = 0; i < kHistogramBuckets; ++i)
+                slot->Buckets_[h][i].store(0, std::memory_order_relaxed);
+        slot->IsInUse_.store(true, std::memory_order_relaxed);
+        slot->Next_ = Slots_.load(std::memory_order_relaxed);
+        while (!Slots_.compare_exchange_weak(
+                   slot->Next_, slot,
+                   std::memory_order_release, std::memory_order_relaxed));
+    }
+    TL_Slot_ = slot;
+    pthread_setspecific(SlotKey_, slot);
+    return slot;
+}
+
+// Thread exit handler
+void StatsRegistry::releaseSlot(void *slot)
+{
+    assert(slot == TL_Slot_);
+    publishFlushes();
+    TL_Slot_ = nullptr;
+    static_cast<StatsSlot*>(slot)->IsInUse_.store(
+        false, std::memory_order_release);
+}
+
+void StatsRegistry::publishFlushes()
+{
+    if (num_flushes == TL_PublishedFlushes_) return;
+    increment(kFlushCount, num_flushes - TL_PublishedFlushes_);
+    TL_PublishedFlushes_ = num_flushes;
+}
+
+///
+/// @brief Sum the counters over all slots. Counters of other threads
+/// may be slightly stale.
+///
+void StatsRegistry::getSnapshot(uint64_t counters[kNumStatsCounters])
+{
+    publishFlushes();
+    for (uint32_t i = 0; i < kNumStatsCounters; ++i) counters[i] = 0;
+    for (StatsSlot *slot = Slots_.load(std::memory_order_acquire);
+         slot; slot = slot->Next_)
+        for (uint32_t i = 0; i < kNumStatsCounters; ++i)
+            counters[i] +=
+                slot->Counters_[i].load(std::memory_order_relaxed);
+}
+
+///
+/// @brief Merge a histogram over all slots
+///
+void StatsRegistry::getHistogramSnapshot(StatsHistogram histogram,
+                                         uint64_t buckets[kHistogramBuckets])
+{
+    for (uint32_t i = 0; i < kHistogramBuckets; ++i) buckets[i] = 0;
+    for (StatsSlot *slot = Slots_.load(std::memory_order_acquire);
+         slot; slot = slot->Next_)
+        for (uint32_t i = 0; i < kHistogramBuckets; ++i)
+            buckets[i] += slot->Buckets_[histogram][i].load(
+                std::memory_order_relaxed);
+}
+
+uint64_t StatsRegistry::getPercentile(
+    const uint64_t buckets[kHistogramBuckets], double fraction)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < kHistogramBuckets; ++i) total += buckets[i];
+    if (!total) return 0;
+    // The rank of the value, starting at 1
+    uint64_t rank = (uint64_t)(fraction * total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kHistogramBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return getHistogramBucketMax(i);
+    }
+    return 0;
+}
+
+void StatsRegistry::printHistograms()
+{
+    static const char *names[kNumStatsHistograms] = {
+        "FASE duration (cycles)", "flushes per FASE",
+        "flush at end of FASE (cycles)" };
+    uint64_t buckets[kHistogramBuckets];
+    for (uint32_t h = 0; h < kNumStatsHistograms; ++h) {
+        getHistogramSnapshot(static_cast<StatsHistogram>(h), buckets);
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < kHistogramBuckets; ++i) total += buckets[i];
+        std::cout << "[Atlas-stats] " << names[h] << ": " << total <<
+            " samples, p50 " << getPercentile(buckets, 0.5) <<
+            " p99 " << getPercentile(buckets, 0.99) <<
+            " p99.9 " << getPercentile(buckets, 0.999) << std::endl;
+        for (uint32_t i = 0; i < kHistogramBuckets; ++i) {
+            if (!buckets[i]) continue;
+            uint64_t lo = i ? getHistogramBucketMax(i - 1) + 1 : 0;
+            std::cout << "\t[" << lo << ", " << getHistogramBucketMax(i) <<
+                "]: " << buckets[i] << std::endl;
+        }
+    }
+}
+
 } // namespace Atlas
 
@@ -30,10 +30,13 @@
 
 #include "util.hpp"
 
-#ifndef _NVDIMM_PROLIANT
-    static const char mountpath[]="/dev/shm/";
-#else
+#if defined(_NVDIMM_PROLIANT)
     static const char mountpath[]="/mnt/nvm/pmem0/";
+#elif defined(_MSYNC_DURABILITY)
+    // Any file system on stable storage
+    static const char mountpath[]="/var/tmp/";
+#else
+    static const char mountpath[]="/dev/shm/";
 #endif
 
 char *NVM_GetRegionTablePath()
@@ -181,6 +184,25 @@ char *NVM_GetLogRegionName(const char * name)
     return s;
 }
 
+char *NVM_GetStatsPagePath()
+{
+    extern const char *__progname;
+    return NVM_GetStatsPagePath(__progname);
+}
+
+char *NVM_GetStatsPagePath(const char *name)
+{
+#ifdef _FORCE_FAIL
+    fail_program();
+#endif
+    const char *usr_name = getpwuid(geteuid())->pw_name;
+    char *s = (char*) malloc(
+        (strlen(mountpath) + strlen(usr_name) + strlen("/__nvm_stats_") +
+         strlen(name) + 1) * sizeof(char));
+    sprintf(s, "%s%s/__nvm_stats_%s", mountpath, usr_name, name);
+    return s;
+}
+
 bool NVM_doesLogExist(const char *log_path_name)
 {
 #ifdef _FORCE_FAIL